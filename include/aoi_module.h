@@ -0,0 +1,25 @@
+#ifndef AOI_MODULE_H
+#define AOI_MODULE_H
+
+#include <zephyr/kernel.h>
+
+#define AOI_PEERS 32 // one sawtooth per node id
+#define AOI_DAY_MS 86400000U // the packed timestamps wrap at midnight
+
+// Packed hh:mm:ss.ms timestamp to ms of the day
+static inline uint32_t aoi_packed_to_ms(uint32_t packed) {
+    return ((packed >> 27) & 0x1F) * 3600000U + ((packed >> 21) & 0x3F) * 60000U +
+           ((packed >> 15) & 0x3F) * 1000U + (packed & 0x3FF);
+}
+
+/*
+ * Account a message of `peer` received at rx_ms (our clock) that the peer
+ * sent at tx_ms (its clock) tx_delay ms after generating it. Returns the
+ * peak of the sawtooth just before this reception, 0 for the first one.
+ */
+uint32_t aoi_update(uint8_t peer, uint32_t rx_ms, uint32_t tx_ms, uint16_t tx_delay);
+
+// Log average and peak AoI of the finished test window and start a new one
+void aoi_window_restart(void);
+
+#endif // AOI_MODULE_H
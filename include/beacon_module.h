@@ -5,6 +5,13 @@
 #include <zephyr/logging/log.h>
 #include <zephyr/bluetooth/bluetooth.h>
 #include <zephyr/bluetooth/gap.h>
+#include "payload_module.h"
+
+// Primary advertising channel map bits
+#define ADV_CHAN_37 BIT(0)
+#define ADV_CHAN_38 BIT(1)
+#define ADV_CHAN_39 BIT(2)
+#define ADV_CHANNELS_ALL (ADV_CHAN_37 | ADV_CHAN_38 | ADV_CHAN_39)
 
 int advertising_module_init(void);
 int advertising_start(bool null_packet);
@@ -12,7 +19,18 @@ int application_init(void);
 int application_stop(void);
 bool get_adv_progress(void);
 bool check_update_availability(void);
+bool wait_update_availability(k_timeout_t timeout);
 int advertising_stop(void);
-void trigger_time_shift(void);
+void generation_shift_phase(int32_t shift_ms);
+int advertising_set_phy(uint8_t primary, uint8_t secondary);
+uint32_t adv_event_airtime_us(uint8_t primary, uint8_t secondary, uint8_t channels, uint16_t ad_len);
+int advertising_set_channels(uint8_t channels);
+void advertising_channel_bench_next(void);
+const char *adv_channels_name(uint8_t channels);
+const char *phy_name(uint8_t phy);
+int advertising_relay(const struct adv_payload *msg, uint8_t copies);
+void advertising_urgent(void);
+// Clock sync reference only: send one sync beacon while no test is running
+int advertising_sync_beacon(void);
 
 #endif // BEACON_MODULE_H
@@ -5,29 +5,55 @@
 
 #define PACKET_COPIES 5
 #define INTERVAL 200
-#define PACKET_GEN_INTERVAL K_MSEC(INTERVAL)  // Frequency X in seconds
 #define ADV_INTERVAL 32 // 20ms
 #define ROLE 1 // 1=master , 0=slave
+#define GEN_JIT 0 // 1 = messages are generated when the burst starts, 0 = at the INTERVAL timer
+#define URGENT_COPIES 10 // events per urgent message, on its own advertising set
+#define URGENT_ADV_INTERVAL 32 // 20ms, the shortest interval allowed for non-connectable advertising
+#define ADV_CHANNELS 0x07 // primary advertising channels, bit 0 = 37, bit 1 = 38, bit 2 = 39
+#define CHANNEL_BENCH 0 // 1 = each test advertises on the next channel map of a fixed rotation
+#define PIGGYBACK_K 0 // previous messages carried as deltas in each burst, > 0 needs extended advertising
+#define ADV_PHY_PRIMARY BT_GAP_LE_PHY_1M // BT_GAP_LE_PHY_1M or BT_GAP_LE_PHY_CODED
+#define ADV_PHY_SECONDARY BT_GAP_LE_PHY_1M // 1M (legacy PDUs if primary is 1M), 2M or CODED (coded primary)
 
 // SCAN PARAMERTERS
 #define SCAN_INTERVAL 80 // 80 = 50ms, 128 = 80 ms - scan setting on the scan module
 #define SCAN_WINDOW 80 // 80 = 50ms, 128 = 80 ms - scan setting on the scan module
 #define SCAN_WINDOW_MAIN 50  //ms - scan setting in the main file
+#define SCAN_PHYS BT_GAP_LE_PHY_1M // primary PHYs to scan, BT_GAP_LE_PHY_1M and/or BT_GAP_LE_PHY_CODED
+#define SCHED_ADAPTIVE 0 // 1 = hold ready bursts out of the learned transmit phase of the peers
+#define SLOTTED_ADV 0 // 1 = start bursts in a self-selected free slot of the INTERVAL superframe (overrides SCHED_ADAPTIVE)
+#define RELAY_MODE 0 // 1 = re-advertise peer messages on the second advertising set
+#define RELAY_TTL 3 // hops our own messages may take when relaying is on
+#define CLOCK_SYNC_BLE 0 // 1 = align clocks and test starts over the air instead of the UART wire
+#define CLOCK_SYNC_REFERENCE ROLE // the node whose clock the others follow
+#define SCAN_LOG_EVERY_COPY 0 // 1 = debug, log every received copy as its own row instead of one row per message
+#define SCAN_DEFERRED_PARSE 0 // 1 = scan_recv only copies raw reports, a parser thread decodes them
+#define RAW_REPORT_SLOTS 32 // raw reports buffered for the parser thread (power of two)
+#define RAW_REPORT_MAX_AD 31 // AD bytes kept per raw report, 31 legacy / up to 255 extended
 
 
-// PACKET STRUCTURE
-typedef struct adv_mfg_data {
-    // uint16_t company_code[2];    // 2 bytes (1 * uint16_t)
-    uint16_t number_press[1];    // 2 bytes (1 * uint16_t)
-    uint32_t timestamp[1];          // 4 bytes
-    uint8_t tx_delay[1];         // 1 bytes (1 * uint8_t)
-    uint32_t latitude[1];            // 4 bytes (scaled integer for latitude)
-    uint32_t longitude[1];           // 4 bytes (scaled integer for longitude)
-} adv_mfg_data_type;
+// NODE IDENTITY, a 5-bit id in the payload header replaces the device name on air
+#ifdef CONFIG_BOARD_NRF9160DK_NRF52840
+    #define NODE_ID 2
+    #define PEER_NODE_ID 1
+#else
+    #if ROLE
+        #define NODE_ID 1
+        #define PEER_NODE_ID 2
+    #else
+        #define NODE_ID 2
+        #define PEER_NODE_ID 1
+    #endif
+#endif
+
+#define NODE_ID_MAX 2 // project nodes use ids 1..NODE_ID_MAX, only those are relayed
+
+#define POS_ANCHOR_EVERY 10 // messages between absolute positions, the others carry a delta
+
+// PACKET STRUCTURE: see the schema in payload_module.h
 
 //PACKET CONTENT
-#define COMPANY_ID_CODE 0x0059
-#define DEVICE_NAME CONFIG_BT_DEVICE_NAME
-#define DEVICE_NAME_LEN (sizeof(DEVICE_NAME) - 1)
+#define COMPANY_ID_CODE 0x0059 // first two bytes of our manufacturer data, tells our messages from other devices
 
 #endif  // BLE_SETTINGS_H
\ No newline at end of file
@@ -0,0 +1,34 @@
+#ifndef CLOCK_SYNC_MODULE_H
+#define CLOCK_SYNC_MODULE_H
+
+#include <zephyr/kernel.h>
+#include "ble_settings.h"
+#include "sdcard_module.h"
+
+#define CLOCK_SYNC_BLOCK_MS 2000 // beacons are reduced to their smallest offset per block
+#define CLOCK_SYNC_POINTS 32 // blocks kept for the regression, about a minute
+#define CLOCK_SYNC_MIN_POINTS 4 // blocks needed before the estimate is used
+#define CLOCK_SYNC_FIXED_DELAY_US 0 // send to receive latency floor removed from the offset, not measured yet
+#define CLOCK_SYNC_BEACON_MS 100 // sync beacon period of the reference while it waits for a test start
+#define CLOCK_SYNC_START_MS 15000 // first test start on the reference clock
+#define CLOCK_SYNC_TEST_GAP_MS 5000 // from the end of one test to the start of the next
+#define CLOCK_SYNC_EPOCH_MS (TEST_PERIOD * 1000 + CLOCK_SYNC_TEST_GAP_MS) // test starts are this far apart
+
+// The reference beacons from its first clock_sync_align() on and a follower needs CLOCK_SYNC_MIN_POINTS
+// blocks of them. With less time left the reference skips the epoch, as the follower cannot make it.
+#define CLOCK_SYNC_LEAD_MS (CLOCK_SYNC_MIN_POINTS * CLOCK_SYNC_BLOCK_MS)
+
+// Feed a beacon of the reference sent at ref_us (its clock, 32-bit wrap) and received at rx_us
+void clock_sync_observe(uint32_t ref_us, int64_t rx_us);
+
+// At least CLOCK_SYNC_MIN_POINTS blocks were fitted, always true on the reference
+bool clock_sync_ready(void);
+
+// Local uptime in ms mapped to the reference clock, unchanged until the estimate is ready
+uint32_t clock_sync_ms(uint32_t local_ms);
+
+// Sleep until the next test start of the reference clock epochs and log the estimate,
+// the reference sends sync beacons meanwhile
+void clock_sync_align(void);
+
+#endif // CLOCK_SYNC_MODULE_H
@@ -0,0 +1,15 @@
+#ifndef CSV_FORMAT_H
+#define CSV_FORMAT_H
+
+#include "sdcard_module.h"
+
+/* Longest row csv_format_row() can produce, including the newline */
+#define CSV_ROW_MAX_LEN 160
+
+/* Encode pkt as one CSV row into buf (CSV_ROW_MAX_LEN bytes), returns the row length */
+int csv_format_row(char *buf, const struct packet_data *pkt);
+
+/* Check a row (without its newline) against its trailing checksum column */
+bool csv_row_valid(const char *line, size_t len);
+
+#endif // CSV_FORMAT_H
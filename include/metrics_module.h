@@ -0,0 +1,96 @@
+#ifndef METRICS_MODULE_H
+#define METRICS_MODULE_H
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+
+#define METRICS_LOG_INTERVAL 10000 // ms between compact stats log lines, 0 = off
+
+// Counters and gauges: X(id, name)
+#define METRICS_LIST(X)                              \
+    X(SCAN_SEEN, "scan_seen")         /* scan_recv calls */               \
+    X(SCAN_ACCEPTED, "scan_accepted") /* reports from our peer */         \
+    X(SCAN_TRUNCATED, "scan_truncated") /* reports whose AD data was cut short */ \
+    X(SCAN_DUPLICATES, "scan_duplicates") /* extra copies folded into one row */ \
+    X(SCAN_SLAB_DROPS, "scan_slab_drops") /* raw reports lost, parser behind */ \
+    X(SCAN_BATCH_PEAK, "scan_batch_peak") /* largest batch the parser took */ \
+    X(QUEUE_DEPTH, "queue_depth")     /* packet_msgq entries in use */    \
+    X(QUEUE_PEAK, "queue_peak")       /* max packet_msgq depth */         \
+    X(QUEUE_DROPS, "queue_drops")     /* records lost to a full queue */  \
+    X(SD_ROWS, "sd_rows")             /* rows handed to append_csv */     \
+    X(SD_WRITES, "sd_writes")         /* sector writes to the card */     \
+    X(SD_WRITE_US, "sd_write_us")     /* total time spent in fs_write */  \
+    X(SD_WRITE_MAX_US, "sd_write_max_us")                                 \
+    X(ADV_BURSTS, "adv_bursts")       /* completed advertising bursts */  \
+    X(ADV_COPIES, "adv_copies")       /* advertising events sent */       \
+    X(ADV_AIRTIME_US, "adv_airtime_us") /* time on air of all events sent */ \
+    X(ADV_BURST_AIRTIME_US, "adv_burst_airtime_us") /* time on air of the last burst */ \
+    X(GEN_DROPS, "gen_drops")         /* messages not generated, previous still pending */ \
+    X(GEN_JITTER_MEAN_US, "gen_jitter_mean_us") /* generation lateness vs. its deadline */ \
+    X(GEN_JITTER_P99_US, "gen_jitter_p99_us")   \
+    X(GEN_JITTER_MAX_US, "gen_jitter_max_us")   \
+    X(SCHED_HOLDS, "sched_holds")     /* bursts held back out of a peer's phase */ \
+    X(SCHED_HOLD_MS, "sched_hold_ms") /* total time bursts were held back */ \
+    X(SLOT_RESELECTS, "slot_reselects") /* slot changes after our gaps were reported */ \
+    X(RELAY_SENT, "relay_sent")       /* messages re-advertised */         \
+    X(RELAY_SUPPRESSED, "relay_suppressed") /* rebroadcasts cancelled, enough copies heard */ \
+    X(RELAY_DROPS, "relay_drops")     /* rebroadcasts lost, relay set busy */ \
+    X(URGENT_SENT, "urgent_sent")     /* urgent messages put on air */     \
+    X(URGENT_DROPS, "urgent_drops")   /* urgent events lost, previous one still on air */ \
+    X(URGENT_LAT_US, "urgent_lat_us") /* event to advertising start, last urgent message */ \
+    X(URGENT_LAT_MAX_US, "urgent_lat_max_us") \
+    X(PIGGYBACK_RECOVERED, "piggyback_recovered") /* lost messages logged from a later history */ \
+    X(CLOCK_SYNC_BEACONS, "clock_sync_beacons") /* reference timestamps received */ \
+    X(CLOCK_SYNC_ERR_US, "clock_sync_err_us") /* mean residual of the clock regression, the unmeasured fixed latency bias is not in it */ \
+    X(CENSUS_REPORTS, "census_reports") /* reports from other devices, last test window */ \
+    X(CENSUS_DEVICES, "census_devices") /* distinct other addresses, linear counting estimate */ \
+    X(CENSUS_RSSI_LT90, "census_rssi_lt90") /* RSSI histogram of those reports in dBm */ \
+    X(CENSUS_RSSI_LT80, "census_rssi_lt80") \
+    X(CENSUS_RSSI_LT70, "census_rssi_lt70") \
+    X(CENSUS_RSSI_LT60, "census_rssi_lt60") \
+    X(CENSUS_RSSI_GE60, "census_rssi_ge60") \
+    X(AOI_AVG_MS, "aoi_avg_ms")       /* average age of information, last peer updated */ \
+    X(AOI_PEAK_MS, "aoi_peak_ms")     /* peak age of information in the test window */
+
+#define METRICS_ENUM(id, name) METRIC_##id,
+enum metric_id {
+    METRICS_LIST(METRICS_ENUM)
+    METRIC_COUNT
+};
+#undef METRICS_ENUM
+
+extern atomic_t metrics[METRIC_COUNT];
+
+static inline void metrics_inc(enum metric_id id) {
+    atomic_inc(&metrics[id]);
+}
+
+static inline void metrics_add(enum metric_id id, uint32_t value) {
+    atomic_add(&metrics[id], value);
+}
+
+static inline void metrics_set(enum metric_id id, uint32_t value) {
+    atomic_set(&metrics[id], value);
+}
+
+// Raise a high-water mark gauge
+static inline void metrics_max(enum metric_id id, uint32_t value) {
+    atomic_val_t old;
+
+    do {
+        old = atomic_get(&metrics[id]);
+        if ((uint32_t)old >= value) {
+            return;
+        }
+    } while (!atomic_cas(&metrics[id], old, value));
+}
+
+static inline uint32_t metrics_get(enum metric_id id) {
+    return (uint32_t)atomic_get(&metrics[id]);
+}
+
+int metrics_init(void);
+void metrics_reset(void);
+void metrics_log(void);
+
+#endif // METRICS_MODULE_H
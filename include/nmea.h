@@ -0,0 +1,19 @@
+#ifndef NMEA_H
+#define NMEA_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Verify the *hh checksum of a $... sentence and cut it off */
+bool nmea_checksum_ok(char *line);
+
+/* ddmm.mmmm / dddmm.mmmm and its N/S/E/W hemisphere to micro-degrees */
+int32_t nmea_coord(const char *value, const char *hemi);
+
+/* hhmmss.ss to ms of the day */
+int32_t nmea_time_ms(const char *value);
+
+/* Parse an RMC or GGA sentence in place, false if it carries no valid fix */
+bool nmea_parse(char *line, int32_t *time_ms, int32_t *lat, int32_t *lon);
+
+#endif // NMEA_H
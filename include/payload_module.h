@@ -0,0 +1,107 @@
+#ifndef PAYLOAD_MODULE_H
+#define PAYLOAD_MODULE_H
+
+#include <zephyr/kernel.h>
+
+// Manufacturer Specific Data starts with the company identifier (COMPANY_ID_CODE), it marks our messages
+#define ADV_PAYLOAD_COMPANY_LEN 2
+
+// Wire schema of the manufacturer data after the company identifier, little-endian, no padding: X(name, type, bytes)
+#define ADV_PAYLOAD_FIXED(X)                                                  \
+    X(header, uint8_t, 1)        /* node id / anchor epoch / anchor flag */   \
+    X(number_press, uint16_t, 2) /* message sequence number */                \
+    X(timestamp, uint32_t, 4)    /* packed hh:mm:ss.ms at send */             \
+    X(tx_delay, uint8_t, 1)      /* ms from generation to send */             \
+    X(gap_report, uint8_t, 1)    /* node id we last saw a sequence gap from, 0 = none */ \
+    X(hops, uint8_t, 1)          /* relay hops taken (bits 0-3), TTL left (bits 4-7) */ \
+    X(msg_type, uint8_t, 1)      /* ADV_MSG_* type, sender channel map, sync flag */
+
+// Position of an anchor message, absolute scaled coordinates
+#define ADV_PAYLOAD_ANCHOR(X)  \
+    X(latitude, uint32_t, 4)   \
+    X(longitude, uint32_t, 4)
+
+// Position of the other messages, offset to the anchor of the same epoch
+#define ADV_PAYLOAD_DELTA(X)   \
+    X(latitude, int16_t, 2)    \
+    X(longitude, int16_t, 2)
+
+// Send time of a clock sync reference, only present with ADV_MSG_SYNC
+#define ADV_PAYLOAD_SYNC(X)    \
+    X(sync_us, uint32_t, 4)
+
+// Piggybacked history, entry i (1..n) after the payload describes message number_press - i
+#define ADV_PAYLOAD_HISTORY(X) \
+    X(dt_ms, uint16_t, 2)      /* its send time before the current one */ \
+    X(dlat, int16_t, 2)        /* its position relative to the current absolute one */ \
+    X(dlon, int16_t, 2)        \
+    X(tx_delay, uint8_t, 1)
+
+#define ADV_HDR_NODE_MASK 0x1F // bits 0-4: sender node id
+#define ADV_HDR_EPOCH_SHIFT 5 // bits 5-6: anchor epoch the delta refers to
+#define ADV_HDR_EPOCH_MASK 0x03
+#define ADV_HDR_ANCHOR 0x80 // bit 7: the position is absolute
+
+#define ADV_HOPS_MASK 0x0F
+#define ADV_TTL_SHIFT 4
+
+#define ADV_MSG_TYPE_MASK 0x0F // bits 0-3: message type
+#define ADV_MSG_CHAN_SHIFT 4 // bits 4-6: primary channels the sender uses, bit 0 = 37
+#define ADV_MSG_CHAN_MASK 0x07
+#define ADV_MSG_PERIODIC 0 // awareness message of the INTERVAL stream
+#define ADV_MSG_URGENT 1 // event message (button, hard brake), always an anchor
+#define ADV_MSG_SYNC 0x80 // flag: a sync_us send timestamp follows the position
+
+#define ADV_PAYLOAD_BYTES(name, type, bytes) + (bytes)
+#define ADV_PAYLOAD_FIXED_LEN (ADV_PAYLOAD_COMPANY_LEN ADV_PAYLOAD_FIXED(ADV_PAYLOAD_BYTES))
+#define ADV_PAYLOAD_ANCHOR_LEN (ADV_PAYLOAD_FIXED_LEN ADV_PAYLOAD_ANCHOR(ADV_PAYLOAD_BYTES))
+#define ADV_PAYLOAD_DELTA_LEN (ADV_PAYLOAD_FIXED_LEN ADV_PAYLOAD_DELTA(ADV_PAYLOAD_BYTES))
+#define ADV_PAYLOAD_SYNC_LEN (0 ADV_PAYLOAD_SYNC(ADV_PAYLOAD_BYTES))
+#define ADV_PAYLOAD_MAX_LEN (ADV_PAYLOAD_ANCHOR_LEN + ADV_PAYLOAD_SYNC_LEN)
+#define ADV_HISTORY_ENTRY_LEN (0 ADV_PAYLOAD_HISTORY(ADV_PAYLOAD_BYTES))
+
+// Decoded payload. For a delta message latitude/longitude hold the sign-extended offset.
+struct adv_payload {
+    uint8_t header;
+    uint16_t number_press;
+    uint32_t timestamp;
+    uint8_t tx_delay;
+    uint32_t latitude;
+    uint32_t longitude;
+    uint8_t gap_report;
+    uint8_t hops;
+    uint8_t msg_type;
+    uint32_t sync_us;
+};
+
+struct adv_history {
+    uint16_t dt_ms;
+    int16_t dlat;
+    int16_t dlon;
+    uint8_t tx_delay;
+};
+
+// Encode into buf (ADV_PAYLOAD_MAX_LEN bytes), returns the number of bytes used
+uint8_t adv_payload_pack(const struct adv_payload *p, uint8_t *buf);
+
+// Decode len bytes of manufacturer data, -EBADMSG if not ours, -EMSGSIZE if too short for its kind
+int adv_payload_unpack(struct adv_payload *p, const uint8_t *buf, size_t len);
+
+// Long enough for the fixed part and starting with our company identifier
+bool adv_payload_is_ours(const uint8_t *buf, size_t len);
+
+// Sender node id of manufacturer data that passed adv_payload_is_ours()
+static inline uint8_t adv_payload_origin(const uint8_t *buf) {
+    return buf[ADV_PAYLOAD_COMPANY_LEN] & ADV_HDR_NODE_MASK;
+}
+
+// Bytes adv_payload_pack() uses for p, the history entries start there
+uint8_t adv_payload_len(const struct adv_payload *p);
+
+// Encode count history entries into buf, returns the number of bytes used
+uint8_t adv_history_pack(const struct adv_history *h, uint8_t count, uint8_t *buf);
+
+// Decode the complete entries of len bytes, at most max, returns how many
+uint8_t adv_history_unpack(struct adv_history *h, uint8_t max, const uint8_t *buf, size_t len);
+
+#endif // PAYLOAD_MODULE_H
@@ -0,0 +1,32 @@
+#ifndef POSITION_MODULE_H
+#define POSITION_MODULE_H
+
+#include <zephyr/kernel.h>
+#include "gnss_module.h"
+
+// Position backends
+#define POSITION_FIXED 0 // constant POSITION_FIXED_LAT/LON
+#define POSITION_GNSS 1 // nRF91 modem GNSS fixes (needs CONFIG_NRF_MODEM_LIB)
+#define POSITION_REPLAY 2 // NMEA trace read from POSITION_REPLAY_FILE
+
+#if defined(CONFIG_NRF_MODEM_LIB)
+    #define POSITION_SOURCE POSITION_GNSS
+#else
+    #define POSITION_SOURCE POSITION_FIXED
+#endif
+
+#define POSITION_FIXED_LAT 52243187 // micro-degrees
+#define POSITION_FIXED_LON 6856186
+#define POSITION_REPLAY_FILE "/SD:/trace.nmea" // $--RMC / $--GGA sentences, replayed in a loop
+#define POSITION_REPLAY_SPEED 1 // 1 = real time, N = N times faster than recorded
+
+// Start the selected backend
+int position_init(void);
+
+// Publish a new fix, one writer at a time (the active backend)
+void position_publish(uint32_t latitude, uint32_t longitude);
+
+// Latest fix, never blocks the caller
+void position_get(struct gnss_s *pos);
+
+#endif // POSITION_MODULE_H
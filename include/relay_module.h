@@ -0,0 +1,19 @@
+#ifndef RELAY_MODULE_H
+#define RELAY_MODULE_H
+
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include "payload_module.h"
+
+#define RELAY_CACHE_LEN 32 // (origin, sequence) pairs remembered
+#define RELAY_SUPPRESS_COUNT 2 // skip our rebroadcast if this many others were heard while waiting
+#define RELAY_DELAY_MIN_MS 5 // random wait before a rebroadcast
+#define RELAY_DELAY_MAX_MS 40
+#define RELAY_COPIES 3 // advertising events per rebroadcast
+
+int relay_init(void);
+
+// Account a message heard from addr and schedule its rebroadcast if it is new and has TTL left
+void relay_observe(const bt_addr_le_t *addr, const struct adv_payload *msg);
+
+#endif // RELAY_MODULE_H
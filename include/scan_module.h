@@ -4,23 +4,31 @@
 #include <zephyr/bluetooth/bluetooth.h>
 #include <zephyr/bluetooth/hci.h>
 
+#define CENSUS_BITMAP_BITS 256 // linear counting bitmap for foreign addresses, power of two
+#define CENSUS_RSSI_BINS 5 // 10 dB bins: < -90, -90..-81, -80..-71, -70..-61, >= -60 dBm
+
 // Function to start Bluetooth scanning
 int ble_start_scanning(void);
+int scan_set_phy(uint8_t phys);
 
 
 bool is_packet_received(void);
 void reset_packet_received(void);
-void reset_last_packet_time(void);
 void switch_recording(bool state);
+// Queue the messages still held for further copies, before a marker row
+void dedup_flush_all(void);
 void reset_packet_queue(void);
 
+// Log reception per sender channel map since the last call and start over
+void scan_channel_stats_restart(void);
+
+// Put the foreign traffic of the finished window into the stats and start a new one
+void scan_census_restart(void);
+
 #if !defined(CONFIG_BOARD_NRF9160DK_NRF52840)
 void append_null(void);
 void append_error(void);
 void append_stop(void);
 #endif
 
-// Callback for Bluetooth scan results
-void scan_cb(const bt_addr_le_t *addr, int8_t rssi, uint8_t adv_type, struct net_buf_simple *buf);
-
 #endif // SCAN_MODULE_H
@@ -0,0 +1,29 @@
+#ifndef SCHED_MODULE_H
+#define SCHED_MODULE_H
+
+#include <zephyr/kernel.h>
+#include "ble_settings.h"
+
+#define SCHED_PEERS 32 // one phase estimate per node id
+#define SCHED_MAX_HOLD_MS (INTERVAL / 2) // longest a ready burst is held back
+#define SCHED_STEP_MS 5 // resolution of the candidate start times
+#define SCHED_STALE_MS (5 * INTERVAL) // a peer not heard for this long is ignored
+// Length of one burst: PACKET_COPIES events ADV_INTERVAL apart plus the random advDelay
+#define SCHED_BURST_MS (PACKET_COPIES * (ADV_INTERVAL * 5 / 8 + 5))
+
+// Slotted mode: the INTERVAL superframe is cut into slots, each node starts its bursts in its own slot
+#define SLOT_MS 10
+#define SLOT_COUNT (INTERVAL / SLOT_MS)
+#define SLOT_RESELECT_MIN_MS (4 * INTERVAL) // ignore further gap reports for this long after a reselection
+#define SLOT_GEN_LEAD_MS 25 // generation is moved this far ahead of the slot, covers the simulated network delay
+
+// Feed the first copy of message seq from peer, with the gap report it carries
+void sched_observe(uint8_t peer, uint32_t uptime_ms, uint16_t seq, uint8_t gap_report);
+
+// How long to keep scanning before the burst ready at now_ms, 0 = send now
+uint32_t sched_adv_delay(uint32_t now_ms);
+
+// Node id to report in the next message after a sequence gap from it, 0 = none
+uint8_t sched_gap_report(void);
+
+#endif // SCHED_MODULE_H
@@ -1,19 +1,61 @@
 #ifndef SDCARD_MODULE_H
 #define SDCARD_MODULE_H
 
+#include <zephyr/kernel.h>
+
 #define CSV_TEST_NAME "sw50n5" //sw50n3, sw50n5, sw80n3, sw50si80
 #define TEST_PERIOD 300 //seconds
 #define TEST_SHIFT 10 //ms
 #define RUNAWAY_PERIOD 30 //seconds. Time to separate the boards after sync
 #define NLOS_TEST 0 // 0 = LOS, 1 = NLOS
+#ifndef CSV_PREALLOC
+#define CSV_PREALLOC 1 // 1 = preallocate each file for TEST_PERIOD worth of rows, 0 = grow on every write
+#endif
+#define CSV_SYNC_ROWS 25 // rows buffered before data and FAT metadata are synced to the card
+#define CSV_SYNC_INTERVAL_MS 2000 // max time rows stay unsynced, bounds the data lost on power loss
+#define CSV_ROW_CHECKSUM 1 // 1 = append a CRC-8 column so torn rows can be dropped at mount
+
+// One CSV row, also the item passed from the scanner to the SD card thread
+struct packet_data {
+    uint16_t number_press;
+    uint16_t tx_delay;
+    uint32_t latitude;
+    uint32_t longitude;
+    uint8_t tx_hour;
+    uint8_t tx_minute;
+    uint8_t tx_second;
+    uint16_t tx_ms;
+    uint8_t rx_hour;
+    uint8_t rx_minute;
+    uint8_t rx_second;
+    uint16_t rx_ms;
+    int8_t rssi;
+    uint32_t aoi;
+    uint8_t copies;        // Copies of this message heard
+    uint16_t copy_spread;  // ms between the first and the last copy
+    uint8_t hops;          // relay hops the message took, 0 = heard from its origin
+    uint8_t origin;        // node id of the sender, sequence numbers are per origin
+    uint8_t msg_type;      // ADV_MSG_PERIODIC or ADV_MSG_URGENT
+    uint8_t chan_map;      // primary channels the sender advertises on, bit 0 = 37
+    uint8_t primary_phy;   // BT_GAP_LE_PHY_* of the report
+    uint8_t secondary_phy; // 0 for legacy PDUs
+    uint8_t sid;           // advertising set id, 255 for legacy PDUs
+    int8_t tx_power;       // dBm advertised by the sender, 127 if not included
+    uint8_t truncated;     // 1 = AD data was cut short
+    uint8_t recovered;     // 1 = not received itself, taken from a later message's history
+};
 
 void set_error_handler(void (*handler)(const char *));
 int sdcard_init(void);
+void sdcard_init_async(void);
+bool sdcard_is_ready(void);
+int sdcard_wait_ready(k_timeout_t timeout);
 int disk_unmount(void);
 int create_csv(void);
-int append_csv(uint16_t number_press, uint16_t tx_delay, uint32_t latitude, uint32_t longitude, 
-              uint8_t tx_hour, uint8_t tx_minute, uint8_t tx_second, uint16_t tx_ms,int8_t rssi,
-              uint8_t rx_hour, uint8_t rx_minute, uint8_t rx_second, uint16_t rx_ms, uint32_t aoi);
+int close_csv(void);
+int sync_csv(bool force);
+k_timeout_t sync_csv_timeout(void);
+int append_csv(const struct packet_data *pkt);
 
 
 #endif // SDCARD_MODULE_H
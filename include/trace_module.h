@@ -0,0 +1,39 @@
+#ifndef TRACE_MODULE_H
+#define TRACE_MODULE_H
+
+#include <zephyr/kernel.h>
+
+#define PIPELINE_TRACE 0 // 1 = record per-packet trace points, dump with "trace dump"
+#define TRACE_RING_LEN 1024 // events per CPU, power of two
+
+// Trace points along the packet pipeline, in pipeline order
+enum trace_point {
+    TRACE_GEN_TIMER,      // generate_packet_data timer fired
+    TRACE_GEN_WORK_START, // delayed_packet_enqueue started
+    TRACE_GEN_WORK_DONE,  // delayed_packet_enqueue marked the packet pending
+    TRACE_ADV_START,      // advertising_start handed the burst to the controller
+    TRACE_ADV_SENT,       // adv_sent_cb, burst finished
+    TRACE_SCAN_RX,        // scan_recv decoded a report from the peer
+    TRACE_QUEUE_PUT,      // record put into packet_msgq
+    TRACE_QUEUE_GET,      // record taken by the SD card thread
+    TRACE_CSV_DONE,       // append_csv returned
+};
+
+// One 8 byte event, the unit of the binary dump
+struct trace_event {
+    uint32_t cycles;
+    uint16_t seq;
+    uint8_t point;
+    uint8_t cpu;
+};
+
+#if PIPELINE_TRACE
+void trace_record(enum trace_point point, uint16_t seq);
+#define TRACE(point, seq) trace_record(point, seq)
+#else
+#define TRACE(point, seq) do { } while (0)
+#endif
+
+int trace_init(void);
+
+#endif // TRACE_MODULE_H
@@ -0,0 +1,163 @@
+#!/usr/bin/env python3
+"""Turn a "trace dump" capture into per-stage latency histograms.
+
+Usage: trace_hist.py <log file> [<log file> ...]
+
+Each log file is a serial capture containing one or more dumps printed by the
+"trace dump" shell command (see src/trace_module.c). Stages are measured
+between consecutive trace points of the same packet sequence number on the
+same board, so the tx side and the rx side are reported separately.
+"""
+
+import re
+import struct
+import sys
+from collections import defaultdict
+
+POINTS = [
+    "gen_timer",
+    "gen_work_start",
+    "gen_work_done",
+    "adv_start",
+    "adv_sent",
+    "scan_rx",
+    "queue_put",
+    "queue_get",
+    "csv_done",
+]
+
+STAGES = [
+    ("gen_timer", "gen_work_start"),
+    ("gen_work_start", "gen_work_done"),
+    ("gen_work_done", "adv_start"),
+    ("adv_start", "adv_sent"),
+    ("gen_timer", "adv_sent"),
+    ("scan_rx", "queue_put"),
+    ("queue_put", "queue_get"),
+    ("queue_get", "csv_done"),
+    ("scan_rx", "csv_done"),
+]
+
+# Events further apart than this are never paired, guards against seq reuse
+MAX_PAIR_US = 2_000_000
+
+EVENT = struct.Struct("<IHBB")
+COUNTER_MASK = 0xFFFFFFFF
+HALF_RANGE = 1 << 31
+HEX_LINE = re.compile(r"^[0-9a-fA-F]+$")
+
+
+def strip_prefix(line):
+    # Console captures may carry timestamps or a shell prompt before the payload
+    line = line.strip()
+    if "TRACE" in line:
+        return line[line.index("TRACE"):]
+    return line.split()[-1] if line else ""
+
+
+def parse_dumps(path):
+    """Yield (freq_hz, [(time_us, point, seq), ...]) per dump found in the file."""
+    freq = None
+    events = []
+    cpu_events = []
+    last_cycles = None
+    unwrapped = 0
+
+    def flush_cpu():
+        events.extend(cpu_events)
+        cpu_events.clear()
+
+    with open(path, errors="replace") as f:
+        for raw in f:
+            line = strip_prefix(raw)
+            if "TRACE BEGIN" in line:
+                fields = line.split()
+                freq = int(fields[4])
+                events = []
+                cpu_events = []
+            elif "TRACE CPU" in line:
+                flush_cpu()
+                last_cycles = None
+                unwrapped = 0
+            elif "TRACE END" in line:
+                flush_cpu()
+                if freq:
+                    yield freq, sorted(events)
+                freq = None
+            elif freq and HEX_LINE.match(line) and len(line) % (EVENT.size * 2) == 0:
+                data = bytes.fromhex(line)
+                for off in range(0, len(data), EVENT.size):
+                    cycles, seq, point, _cpu = EVENT.unpack_from(data, off)
+                    # Unwrap the 32 bit counter with signed modular deltas, so a small step
+                    # back from events recorded out of order is not taken for a wrap
+                    if last_cycles is None:
+                        unwrapped = cycles
+                    else:
+                        unwrapped += ((cycles - last_cycles + HALF_RANGE) & COUNTER_MASK) - HALF_RANGE
+                    last_cycles = cycles
+                    time_us = unwrapped * 1_000_000 / freq
+                    if point < len(POINTS):
+                        cpu_events.append((time_us, POINTS[point], seq))
+
+
+def stage_latencies(events):
+    latest = {}
+    samples = defaultdict(list)
+    for time_us, point, seq in events:
+        for start, end in STAGES:
+            if point != end:
+                continue
+            begin = latest.get((start, seq))
+            if begin is not None and 0 <= time_us - begin <= MAX_PAIR_US:
+                samples[(start, end)].append(time_us - begin)
+        # Keep the first copy of repeated points (e.g. scan_rx per copy) until the seq moves on
+        key = (point, seq)
+        if key not in latest or time_us - latest[key] > MAX_PAIR_US:
+            latest[key] = time_us
+    return samples
+
+
+def percentile(values, pct):
+    idx = min(len(values) - 1, int(len(values) * pct / 100))
+    return values[idx]
+
+
+def print_histogram(name, values):
+    values.sort()
+    print(f"{name}: n={len(values)} p50={percentile(values, 50):.0f}us "
+          f"p90={percentile(values, 90):.0f}us p99={percentile(values, 99):.0f}us "
+          f"max={values[-1]:.0f}us")
+    buckets = defaultdict(int)
+    for v in values:
+        buckets[max(0, int(v).bit_length() - 1)] += 1
+    peak = max(buckets.values())
+    for b in sorted(buckets):
+        bar = "#" * max(1, buckets[b] * 40 // peak)
+        print(f"  [{1 << b:>8} us, {1 << (b + 1):>8} us) {buckets[b]:>6} {bar}")
+
+
+def main():
+    if len(sys.argv) < 2:
+        print(__doc__)
+        return 1
+
+    samples = defaultdict(list)
+    dumps = 0
+    for path in sys.argv[1:]:
+        for _freq, events in parse_dumps(path):
+            dumps += 1
+            for stage, values in stage_latencies(events).items():
+                samples[stage].extend(values)
+
+    if not dumps:
+        print("No trace dumps found")
+        return 1
+
+    for start, end in STAGES:
+        if samples[(start, end)]:
+            print_histogram(f"{start} -> {end}", samples[(start, end)])
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
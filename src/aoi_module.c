@@ -0,0 +1,107 @@
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include "aoi_module.h"
+#include "metrics_module.h"
+
+LOG_MODULE_REGISTER(aoi_module, LOG_LEVEL_INF);
+
+/*
+ * Age of information per peer: at time t the age is t minus the generation
+ * time of the freshest message received so far, a sawtooth that drops at
+ * each fresher reception. The peer's clock is mapped to ours with the
+ * smallest rx - tx seen in the window, i.e. the clock offset plus the
+ * latency floor of the link. Average and peak are kept incrementally.
+ */
+struct aoi_peer {
+    bool active;
+    int32_t offset;      // ms to add to the peer clock to get ours
+    uint32_t fresh_gen;  // generation time of the freshest message, peer clock
+    uint32_t last_rx;    // time of the previous update, our clock
+    uint64_t area;       // integral of the age over the window, ms * ms
+    uint32_t span;       // ms covered by area
+    uint32_t peak;       // largest age seen in the window
+    uint32_t updates;
+};
+
+static struct aoi_peer aoi_peers[AOI_PEERS];
+static struct k_spinlock aoi_lock;
+
+// a - b on the ms-of-day clock, in [-12 h, 12 h)
+static int32_t day_diff(uint32_t a, uint32_t b) {
+    int32_t d = (int32_t)((a + AOI_DAY_MS - b) % AOI_DAY_MS);
+
+    return d >= (int32_t)(AOI_DAY_MS / 2) ? d - (int32_t)AOI_DAY_MS : d;
+}
+
+// Age at rx of the freshest message, never negative
+static uint32_t age_at(const struct aoi_peer *p, uint32_t rx_ms) {
+    int32_t age = day_diff(rx_ms, p->fresh_gen) - p->offset;
+
+    return age > 0 ? age : 0;
+}
+
+uint32_t aoi_update(uint8_t peer, uint32_t rx_ms, uint32_t tx_ms, uint16_t tx_delay) {
+    struct aoi_peer *p = &aoi_peers[peer % AOI_PEERS];
+    uint32_t gen = (tx_ms + AOI_DAY_MS - tx_delay) % AOI_DAY_MS;
+    int32_t rx_minus_tx = day_diff(rx_ms, tx_ms);
+    uint32_t peak = 0;
+
+    k_spinlock_key_t key = k_spin_lock(&aoi_lock);
+
+    if (!p->active) {
+        *p = (struct aoi_peer){
+            .active = true,
+            .offset = rx_minus_tx,
+            .fresh_gen = gen,
+            .last_rx = rx_ms,
+        };
+    } else {
+        if (rx_minus_tx < p->offset) {
+            p->offset = rx_minus_tx;
+        }
+
+        // Area under the ramp since the previous update, ending at the peak
+        int32_t dt = day_diff(rx_ms, p->last_rx);
+
+        peak = age_at(p, rx_ms);
+        if (dt > 0) {
+            p->area += (uint64_t)dt * peak - (uint64_t)dt * dt / 2;
+            p->span += dt;
+            p->last_rx = rx_ms;
+        }
+        if (peak > p->peak) {
+            p->peak = peak;
+        }
+        if (day_diff(gen, p->fresh_gen) > 0) {
+            p->fresh_gen = gen;
+        }
+    }
+    p->updates++;
+
+    uint32_t avg = p->span ? (uint32_t)(p->area / p->span) : 0;
+
+    k_spin_unlock(&aoi_lock, key);
+
+    metrics_set(METRIC_AOI_AVG_MS, avg);
+    metrics_max(METRIC_AOI_PEAK_MS, peak);
+    return peak;
+}
+
+void aoi_window_restart(void) {
+    k_spinlock_key_t key = k_spin_lock(&aoi_lock);
+
+    for (int i = 0; i < AOI_PEERS; i++) {
+        struct aoi_peer *p = &aoi_peers[i];
+
+        if (p->active && p->span) {
+            LOG_INF("AoI node %d: avg %u ms, peak %u ms (%u msgs over %u ms, offset %d ms)", i,
+                    (uint32_t)(p->area / p->span), p->peak, p->updates, p->span, p->offset);
+        }
+        p->active = false;
+    }
+
+    k_spin_unlock(&aoi_lock, key);
+
+    metrics_set(METRIC_AOI_AVG_MS, 0);
+    metrics_set(METRIC_AOI_PEAK_MS, 0);
+}
@@ -1,16 +1,46 @@
 #include <stdlib.h>
+#include <string.h>
 #include <zephyr/random/random.h>
+#include <zephyr/shell/shell.h>
 #include "ble_settings.h"
 #include "beacon_module.h"
+#include "aoi_module.h"
+#include "clock_sync_module.h"
 #include "gnss_module.h"
+#include "position_module.h"
+#include "sched_module.h"
 #include "sdcard_module.h"
+#include "metrics_module.h"
+#include "payload_module.h"
+#include "trace_module.h"
 
 LOG_MODULE_REGISTER(beacon_module, LOG_LEVEL_INF);
 
-static adv_mfg_data_type adv_mfg_data;
+static struct adv_payload adv_mfg_data;
+static uint8_t adv_mfg_buf[ADV_PAYLOAD_MAX_LEN + PIGGYBACK_K * ADV_HISTORY_ENTRY_LEN]; // adv_mfg_data encoded for the air
+
+// Only checked where the controller is built in. The nRF5340 network core and the nRF9160 DK's
+// nRF52840 take their limit from child_image/, bt_le_ext_adv_set_data() fails there if it is too small.
+#ifdef CONFIG_BT_CTLR_ADV_DATA_LEN_MAX
+BUILD_ASSERT(3 + 2 + sizeof(adv_mfg_buf) <= CONFIG_BT_CTLR_ADV_DATA_LEN_MAX,
+             "PIGGYBACK_K entries exceed the controller advertising data length");
+#endif
+
+#if PIGGYBACK_K
+// Messages sent before the current one, newest first, for the piggybacked history
+struct sent_msg {
+    uint16_t seq;
+    uint32_t ts_ms;  // send time, ms of the day
+    uint8_t tx_delay;
+    uint32_t latitude;
+    uint32_t longitude;
+};
+
+static struct sent_msg sent_history[PIGGYBACK_K];
+static uint8_t sent_history_count;
+#endif
 
 static struct rtc_time_s rtc_time = {0,0,0,0,0};
-static struct gnss_s last_gnss_data  = {52243187,6856186};
 
 struct packet_content {
     uint32_t tx_delay;
@@ -20,36 +50,54 @@ struct packet_content {
 
 static struct packet_content current_packet; // Single-packet buffer
 static bool packet_pending = false; // Indicates if a packet is waiting to be served
-static uint32_t override_interval = 0;  // 0 means no override
 
 static struct k_timer packet_gen_timer;
 static struct k_work packet_work;
 
-// static int start_time = 0;
-static bool fix_drift = false;
-
-#ifdef CONFIG_BOARD_NRF9160DK_NRF52840
-    #define DEVICE_NAME "B2B2"
-#else
-    #if ROLE
-        #define DEVICE_NAME "B2B1"
-    #else
-        #define DEVICE_NAME "B2B2"
-    #endif
-#endif
+// Message n is due at gen_start + n * INTERVAL + gen_phase_ms, so errors never accumulate
+static int64_t gen_start;
+static uint32_t gen_seq;
+static int32_t gen_phase_ms;
+static int64_t gen_deadline; // deadline of the slot being generated
+static struct k_spinlock gen_lock;
 
-#define DEVICE_NAME_LEN (sizeof(DEVICE_NAME) - 1)
+// Generation jitter histogram, bucket i counts lateness in [2^i, 2^(i+1)) us
+#define GEN_JITTER_BUCKETS 16
+static uint32_t gen_jitter_hist[GEN_JITTER_BUCKETS];
+static uint32_t gen_jitter_count;
+static uint64_t gen_jitter_sum_us;
+static uint32_t gen_jitter_max_us;
 
-// Manufacturer Specific Data configuration
+// Manufacturer Specific Data configuration, the node id in the payload replaces the device name
 static struct bt_le_ext_adv *adv_set;
-static const struct bt_data ad[] = {
+static struct bt_data ad[] = {
     BT_DATA_BYTES(BT_DATA_FLAGS, BT_LE_AD_NO_BREDR),
-    BT_DATA(BT_DATA_NAME_COMPLETE, DEVICE_NAME, DEVICE_NAME_LEN),
-    BT_DATA(BT_DATA_MANUFACTURER_DATA, (unsigned char *)&adv_mfg_data, sizeof(adv_mfg_data)),
+    BT_DATA(BT_DATA_MANUFACTURER_DATA, adv_mfg_buf, ADV_PAYLOAD_ANCHOR_LEN),
 };
+#define AD_MFG_IDX 1
 
+// Last absolute position sent, deltas are relative to it
+static bool pos_anchor_valid = false;
+static uint8_t pos_epoch = 0;
+static uint32_t pos_anchor_lat;
+static uint32_t pos_anchor_lon;
+static uint16_t pos_since_anchor;
+
+static bool first_adv_done = false; // Boot to first advertisement is logged once
+
+// Advertising PHYs and primary channels, a change is applied before the next burst
+static uint8_t adv_phy_primary = ADV_PHY_PRIMARY;
+static uint8_t adv_phy_secondary = ADV_PHY_SECONDARY;
+static uint8_t adv_channels = ADV_CHANNELS;
+static bool adv_param_changed = false;
+// What the main set currently runs with, restored when the controller rejects a change
+static uint8_t adv_applied_primary = ADV_PHY_PRIMARY;
+static uint8_t adv_applied_secondary = ADV_PHY_SECONDARY;
+static uint8_t adv_applied_channels = ADV_CHANNELS;
+static uint32_t adv_event_airtime = 0; // us on air per advertising event with the current data
 static bool advertising_complete_flag = false; // Flag for advertising completion
 static bool update_availability_flag = false; // Flag for content availability
+static K_SEM_DEFINE(packet_ready_sem, 0, 1); // Given when a message becomes available
 bool get_adv_progress(void) {
     return advertising_complete_flag;
 }
@@ -58,8 +106,23 @@ bool check_update_availability(void) {
     return update_availability_flag;
 }
 
+// Block until a message is available or the timeout expires
+bool wait_update_availability(k_timeout_t timeout) {
+    if (!update_availability_flag) {
+        k_sem_take(&packet_ready_sem, timeout);
+    }
+    return update_availability_flag;
+}
+
 static void adv_sent_cb(struct bt_le_ext_adv *adv, struct bt_le_ext_adv_sent_info *info) {
     // LOG_INF("Advertising stopped after %u events", info->num_sent);
+    TRACE(TRACE_ADV_SENT, adv_mfg_data.number_press);
+    metrics_inc(METRIC_ADV_BURSTS);
+    metrics_add(METRIC_ADV_COPIES, info->num_sent);
+    metrics_add(METRIC_ADV_AIRTIME_US, info->num_sent * adv_event_airtime);
+    metrics_set(METRIC_ADV_BURST_AIRTIME_US, info->num_sent * adv_event_airtime);
+    LOG_DBG("Burst airtime %u us (%u events, %s/%s)", info->num_sent * adv_event_airtime,
+            info->num_sent, phy_name(adv_phy_primary), phy_name(adv_phy_secondary));
     advertising_complete_flag = true;
     update_availability_flag = false; // Reset availability after advertising
     packet_pending = false; // Mark packet as processed
@@ -78,7 +141,7 @@ uint32_t random_delay(uint32_t min_ms, uint32_t max_ms) {
 // Function to get current time as a single integer
 static uint32_t get_current_time_packed(void) {
     // Calculate runtime milliseconds since last update
-    uint32_t runtime_ms = k_uptime_get() - rtc_time.last_runtime;
+    uint32_t runtime_ms = clock_sync_ms(k_uptime_get_32()) - rtc_time.last_runtime;
     uint32_t total_ms = rtc_time.ms + runtime_ms;
 
     // Calculate the components of the current time
@@ -107,61 +170,125 @@ static uint32_t get_current_time_packed(void) {
     return packed_time;
 }
 
+// Upper bound of the bucket holding the given percentile
+static uint32_t gen_jitter_percentile(uint32_t percent) {
+    uint32_t target = (gen_jitter_count * percent + 99) / 100;
+    uint32_t seen = 0;
+
+    for (int i = 0; i < GEN_JITTER_BUCKETS; i++) {
+        seen += gen_jitter_hist[i];
+        if (seen >= target) {
+            return MIN(1U << (i + 1), gen_jitter_max_us);
+        }
+    }
+    return gen_jitter_max_us;
+}
+
+static void record_gen_jitter(uint32_t us) {
+    uint32_t bucket = us ? MIN(31 - __builtin_clz(us), GEN_JITTER_BUCKETS - 1) : 0;
+
+    gen_jitter_hist[bucket]++;
+    gen_jitter_count++;
+    gen_jitter_sum_us += us;
+    if (us > gen_jitter_max_us) {
+        gen_jitter_max_us = us;
+    }
+
+    metrics_set(METRIC_GEN_JITTER_MEAN_US, gen_jitter_sum_us / gen_jitter_count);
+    metrics_set(METRIC_GEN_JITTER_P99_US, gen_jitter_percentile(99));
+    metrics_set(METRIC_GEN_JITTER_MAX_US, gen_jitter_max_us);
+}
+
+// Log the lateness of generation against the deadlines of this test and start over
+static void log_gen_jitter(void) {
+    if (gen_jitter_count == 0) {
+        return;
+    }
+
+    LOG_INF("Generation jitter: %u msgs, mean %u us, p99 <= %u us, max %u us", gen_jitter_count,
+            (uint32_t)(gen_jitter_sum_us / gen_jitter_count), gen_jitter_percentile(99),
+            gen_jitter_max_us);
+
+    memset(gen_jitter_hist, 0, sizeof(gen_jitter_hist));
+    gen_jitter_count = 0;
+    gen_jitter_sum_us = 0;
+    gen_jitter_max_us = 0;
+}
+
 // Function to generate and enqueue new packet data - Appliocation layer
 static void delayed_packet_enqueue(struct k_work *work) {
+    TRACE(TRACE_GEN_WORK_START, adv_mfg_data.number_press + 1);
+    record_gen_jitter(k_ticks_to_us_floor32(MAX(k_uptime_ticks() - gen_deadline, 0)));
     if (packet_pending) {
         // LOG_WRN("Packet dropped: A previous packet is still being processed.");
+        metrics_inc(METRIC_GEN_DROPS);
         return;
     }
 
+    #if GEN_JIT
+    // Content, position and time are sampled in advertising_start, right before the burst
+    current_packet.press_count = adv_mfg_data.number_press + 1;
+    #else
     // Populate new packet content
-    int prev_gen = current_packet.tx_delay;
     current_packet.tx_delay = k_uptime_get();
-    current_packet.press_count = adv_mfg_data.number_press[0] + 1;
-    int time_diff = current_packet.tx_delay - prev_gen - INTERVAL;
-    // LOG_INF("Packet generating period: %u / cycle ticks: %d / Diff: %d", (current_packet.tx_delay-prev_gen),(k_cycle_get_32() - start_time), time_diff);
-    // start_time = k_cycle_get_32();
-
-    // Check if the time difference is different than your desired interval
-    if (abs(time_diff) > 0 && abs(time_diff) <= 5) {
-        if (!fix_drift) {
-            int fix = INTERVAL - time_diff;
-            // LOG_INF("Adjusting time delay by %d ms, next period %d", time_diff, fix);  // Log the adjustment
-            k_timer_start(&packet_gen_timer, K_MSEC(fix), PACKET_GEN_INTERVAL);
-            fix_drift = true;
-        } else {
-            fix_drift = false;
-        }
-    }
+    current_packet.press_count = adv_mfg_data.number_press + 1;
 
     // Simulate network layer delay
     random_delay(11, 20);
+    #endif
 
     // Mark the packet as ready to be advertised
     packet_pending = true;
     update_availability_flag = true;
+    k_sem_give(&packet_ready_sem);
+    TRACE(TRACE_GEN_WORK_DONE, current_packet.press_count);
 }
 
-static void generate_packet_data(struct k_timer *dummy) {
-    k_work_submit(&packet_work);  // Schedule work to handle delay and queue
+static int64_t gen_deadline_of(uint32_t seq) {
+    return gen_start + k_ms_to_ticks_ceil64(MAX((int64_t)seq * INTERVAL + gen_phase_ms, 0));
+}
+
+// Arm the timer for the next slot that is still ahead, missed slots count as drops
+static void gen_schedule_next(void) {
+    int64_t now = k_uptime_ticks();
 
-    // Check if an override interval is set
-    if (override_interval) {
-        k_timer_start(&packet_gen_timer, K_MSEC(override_interval), PACKET_GEN_INTERVAL);
-        override_interval = 0;  // Reset after one-time use
+    gen_seq++;
+    while (gen_deadline_of(gen_seq) <= now) {
+        gen_seq++;
+        metrics_inc(METRIC_GEN_DROPS);
     }
+
+    k_timer_start(&packet_gen_timer, K_TIMEOUT_ABS_TICKS(gen_deadline_of(gen_seq)), K_NO_WAIT);
+}
+
+static void generate_packet_data(struct k_timer *dummy) {
+    TRACE(TRACE_GEN_TIMER, adv_mfg_data.number_press + 1);
+    k_spinlock_key_t key = k_spin_lock(&gen_lock);
+
+    gen_deadline = gen_deadline_of(gen_seq);
+    k_work_submit(&packet_work);  // Schedule work to handle delay and queue
+    gen_schedule_next();
+    k_spin_unlock(&gen_lock, key);
 }
 
-// Function to modify the interval for only one iteration
-void trigger_time_shift(void) {
-    override_interval = TEST_SHIFT + INTERVAL;
+// Move the following deadlines by shift_ms without restarting the sequence
+void generation_shift_phase(int32_t shift_ms) {
+    k_spinlock_key_t key = k_spin_lock(&gen_lock);
+
+    gen_phase_ms += shift_ms;
+    k_timer_start(&packet_gen_timer, K_TIMEOUT_ABS_TICKS(gen_deadline_of(gen_seq)), K_NO_WAIT);
+    k_spin_unlock(&gen_lock, key);
 }
 
 // Initialize the timer for packet generation
 int application_init(void) {
     k_work_init(&packet_work, delayed_packet_enqueue); // Initialize work item
     k_timer_init(&packet_gen_timer, generate_packet_data, NULL);
-    k_timer_start(&packet_gen_timer, PACKET_GEN_INTERVAL, PACKET_GEN_INTERVAL);
+    gen_start = k_uptime_ticks();
+    gen_seq = 1;
+    gen_phase_ms = 0;
+    k_timer_start(&packet_gen_timer, K_TIMEOUT_ABS_TICKS(gen_deadline_of(gen_seq)), K_NO_WAIT);
+    LOG_INF("Packet generation: %s", GEN_JIT ? "just in time" : "timer");
     return 0;
 }
 
@@ -176,33 +303,492 @@ int application_stop(void) {
         k_work_flush(&packet_work, NULL);
     }
 
+    log_gen_jitter();
     LOG_INF("Application stopped: Timer and work queue reset");
     return 0;
 }
 
 
-int advertising_module_init(void) {
-    int err;
+const char *phy_name(uint8_t phy) {
+    switch (phy) {
+    case BT_GAP_LE_PHY_1M:
+        return "1M";
+    case BT_GAP_LE_PHY_2M:
+        return "2M";
+    case BT_GAP_LE_PHY_CODED:
+        return "Coded";
+    default:
+        return "?";
+    }
+}
 
-    // LOG_INF("Initializing Advertising Module\n");
+// Legacy PDUs are kept for 1M/1M so that behaviour matches older builds, the history needs extended ones
+static bool adv_phy_is_legacy(uint8_t primary, uint8_t secondary) {
+    return primary == BT_GAP_LE_PHY_1M && secondary == BT_GAP_LE_PHY_1M && PIGGYBACK_K == 0;
+}
 
-    // Initialize the advertising data
-    struct bt_le_adv_param adv_param = {
+// On-air time of one packet with a `pdu_len` byte PDU (header included)
+static uint32_t pdu_airtime_us(uint8_t phy, uint16_t pdu_len) {
+    switch (phy) {
+    case BT_GAP_LE_PHY_2M:
+        // 2 byte preamble, access address, PDU, CRC at 4 us per byte
+        return (2 + 4 + pdu_len + 3) * 4;
+    case BT_GAP_LE_PHY_CODED:
+        // S8: preamble 80, access address 256, CI 16, TERM1 24, PDU+CRC 64/byte, TERM2 24
+        return 80 + 256 + 16 + 24 + (pdu_len + 3) * 64 + 24;
+    default:
+        // 1 byte preamble, access address, PDU, CRC at 8 us per byte
+        return (1 + 4 + pdu_len + 3) * 8;
+    }
+}
+
+/*
+ * Airtime of one advertising event carrying `ad_len` bytes of AD data on
+ * `channels` primary channels. Legacy: ADV_NONCONN_IND (header + AdvA + AD) on
+ * each channel. Extended: ADV_EXT_IND (header + ext header with ADI and
+ * AuxPtr) on each primary channel plus one AUX_ADV_IND (header + ext header
+ * with AdvA and ADI + AD) on the secondary PHY.
+ */
+static uint32_t event_airtime_us(bool legacy, uint8_t primary, uint8_t secondary, uint8_t channels,
+                                 uint16_t ad_len) {
+    if (legacy) {
+        return channels * pdu_airtime_us(BT_GAP_LE_PHY_1M, 2 + 6 + ad_len);
+    }
+    return channels * pdu_airtime_us(primary, 2 + 1 + 1 + 2 + 3) +
+           pdu_airtime_us(secondary, 2 + 1 + 1 + 6 + 2 + ad_len);
+}
+
+uint32_t adv_event_airtime_us(uint8_t primary, uint8_t secondary, uint8_t channels, uint16_t ad_len) {
+    return event_airtime_us(adv_phy_is_legacy(primary, secondary), primary, secondary, channels, ad_len);
+}
+
+const char *adv_channels_name(uint8_t channels) {
+    static const char *const names[] = {
+        "none", "37", "38", "37+38", "39", "37+39", "38+39", "37+38+39",
+    };
+
+    return names[channels & ADV_CHANNELS_ALL];
+}
+
+// Leave out the primary channels not in `channels`
+static void adv_param_channels(struct bt_le_adv_param *param, uint8_t channels) {
+    if (!(channels & ADV_CHAN_37)) {
+        param->options |= BT_LE_ADV_OPT_DISABLE_CHAN_37;
+    }
+    if (!(channels & ADV_CHAN_38)) {
+        param->options |= BT_LE_ADV_OPT_DISABLE_CHAN_38;
+    }
+    if (!(channels & ADV_CHAN_39)) {
+        param->options |= BT_LE_ADV_OPT_DISABLE_CHAN_39;
+    }
+}
+
+static uint16_t ad_total_len(const struct bt_data *data, size_t count) {
+    uint16_t len = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        len += 2 + data[i].data_len;
+    }
+    return len;
+}
+
+static int adv_param_build(struct bt_le_adv_param *param, uint8_t primary, uint8_t secondary) {
+    *param = (struct bt_le_adv_param) {
         .options = BT_LE_ADV_OPT_NONE,
         .interval_min = ADV_INTERVAL,
         .interval_max = ADV_INTERVAL,
         .peer = NULL,
     };
 
-    err = bt_le_ext_adv_create(&adv_param, &adv_callbacks, &adv_set);
+    if (adv_phy_is_legacy(primary, secondary)) {
+        return 0;
+    }
+
+    // The host only supports 1M/1M, 1M/2M and Coded/Coded for extended advertising
+    param->options |= BT_LE_ADV_OPT_EXT_ADV;
+    if (primary == BT_GAP_LE_PHY_1M && secondary == BT_GAP_LE_PHY_1M) {
+        param->options |= BT_LE_ADV_OPT_NO_2M;
+        return 0;
+    }
+    if (primary == BT_GAP_LE_PHY_1M && secondary == BT_GAP_LE_PHY_2M) {
+        return 0;
+    }
+    if (primary == BT_GAP_LE_PHY_CODED && secondary == BT_GAP_LE_PHY_CODED) {
+        param->options |= BT_LE_ADV_OPT_CODED;
+        return 0;
+    }
+    return -ENOTSUP;
+}
+
+int advertising_set_phy(uint8_t primary, uint8_t secondary) {
+    struct bt_le_adv_param adv_param;
+
+    if (adv_param_build(&adv_param, primary, secondary)) {
+        return -ENOTSUP;
+    }
+
+    adv_phy_primary = primary;
+    adv_phy_secondary = secondary;
+    adv_param_changed = true;
+    return 0;
+}
+
+int advertising_set_channels(uint8_t channels) {
+    if ((channels & ADV_CHANNELS_ALL) == 0 || (channels & ~ADV_CHANNELS_ALL)) {
+        return -EINVAL;
+    }
+
+    adv_channels = channels;
+    adv_param_changed = true;
+    return 0;
+}
+
+// Channel maps of the CHANNEL_BENCH rotation: all, each single channel, each pair
+static const uint8_t channel_bench_maps[] = {
+    ADV_CHANNELS_ALL, ADV_CHAN_37, ADV_CHAN_38, ADV_CHAN_39,
+    ADV_CHAN_37 | ADV_CHAN_38, ADV_CHAN_37 | ADV_CHAN_39, ADV_CHAN_38 | ADV_CHAN_39,
+};
+static uint8_t channel_bench_index;
+
+void advertising_channel_bench_next(void) {
+    uint8_t channels = channel_bench_maps[channel_bench_index];
+
+    channel_bench_index = (channel_bench_index + 1) % ARRAY_SIZE(channel_bench_maps);
+    advertising_set_channels(channels);
+    LOG_INF("Channel benchmark: advertising on %s for this test", adv_channels_name(channels));
+}
+
+// Apply a pending PHY or channel change, the set must not be advertising.
+// A change the controller rejects is dropped and advertising goes on with the previous parameters.
+static void advertising_apply_param(void) {
+    struct bt_le_adv_param adv_param;
+
+    adv_param_changed = false;
+    adv_param_build(&adv_param, adv_phy_primary, adv_phy_secondary);
+    adv_param_channels(&adv_param, adv_channels);
+
+    int err = bt_le_ext_adv_update_param(adv_set, &adv_param);
+    if (err) {
+        LOG_ERR("Advertising PHY %s/%s on %s rejected (err %d), keeping %s/%s on %s",
+                phy_name(adv_phy_primary), phy_name(adv_phy_secondary),
+                adv_channels_name(adv_channels), err, phy_name(adv_applied_primary),
+                phy_name(adv_applied_secondary), adv_channels_name(adv_applied_channels));
+        adv_phy_primary = adv_applied_primary;
+        adv_phy_secondary = adv_applied_secondary;
+        adv_channels = adv_applied_channels;
+        return;
+    }
+    adv_applied_primary = adv_phy_primary;
+    adv_applied_secondary = adv_phy_secondary;
+    adv_applied_channels = adv_channels;
+
+    LOG_INF("Advertising PHY %s/%s on %s, airtime per burst %u us", phy_name(adv_phy_primary),
+            phy_name(adv_phy_secondary), adv_channels_name(adv_channels),
+            PACKET_COPIES * adv_event_airtime_us(adv_phy_primary, adv_phy_secondary,
+                                                 __builtin_popcount(adv_channels),
+                                                 ad_total_len(ad, ARRAY_SIZE(ad))));
+}
+
+// Bring an idle secondary set to the PHYs of the main set, primary/secondary hold its current ones.
+// The secondary sets keep all three primary channels.
+static int adv_set_follow_phy(struct bt_le_ext_adv *set, uint16_t interval, uint8_t *primary,
+                              uint8_t *secondary) {
+    struct bt_le_adv_param adv_param;
+
+    if (*primary == adv_phy_primary && *secondary == adv_phy_secondary) {
+        return 0;
+    }
+
+    adv_param_build(&adv_param, adv_phy_primary, adv_phy_secondary);
+    adv_param.interval_min = interval;
+    adv_param.interval_max = interval;
+
+    int err = bt_le_ext_adv_update_param(set, &adv_param);
+    if (err) {
+        return err;
+    }
+    *primary = adv_phy_primary;
+    *secondary = adv_phy_secondary;
+    return 0;
+}
+
+// Second set for rebroadcasts of other nodes' messages (RELAY_MODE)
+static struct bt_le_ext_adv *relay_set;
+static uint8_t relay_buf[ADV_PAYLOAD_MAX_LEN];
+static struct bt_data relay_ad[] = {
+    BT_DATA_BYTES(BT_DATA_FLAGS, BT_LE_AD_NO_BREDR),
+    BT_DATA(BT_DATA_MANUFACTURER_DATA, relay_buf, ADV_PAYLOAD_ANCHOR_LEN),
+};
+static atomic_t relay_busy = ATOMIC_INIT(0);
+static uint8_t relay_phy_primary = ADV_PHY_PRIMARY;
+static uint8_t relay_phy_secondary = ADV_PHY_SECONDARY;
+
+static void relay_sent_cb(struct bt_le_ext_adv *adv, struct bt_le_ext_adv_sent_info *info) {
+    metrics_add(METRIC_ADV_AIRTIME_US,
+                info->num_sent * adv_event_airtime_us(relay_phy_primary, relay_phy_secondary, 3,
+                                                      ad_total_len(relay_ad, ARRAY_SIZE(relay_ad))));
+    atomic_clear(&relay_busy);
+}
+
+static struct bt_le_ext_adv_cb relay_callbacks = {
+    .sent = relay_sent_cb,
+};
+
+int advertising_relay(const struct adv_payload *msg, uint8_t copies) {
+    struct bt_le_ext_adv_start_param start_param = {
+        .timeout = 0,
+        .num_events = copies
+    };
+    int err;
+
+    if (!relay_set) {
+        return -ENOTSUP;
+    }
+    if (!atomic_cas(&relay_busy, 0, 1)) {
+        return -EBUSY;
+    }
+
+    err = adv_set_follow_phy(relay_set, ADV_INTERVAL, &relay_phy_primary, &relay_phy_secondary);
+    if (err) {
+        goto fail;
+    }
+
+    relay_ad[AD_MFG_IDX].data_len = adv_payload_pack(msg, relay_buf);
+    err = bt_le_ext_adv_set_data(relay_set, relay_ad, ARRAY_SIZE(relay_ad), NULL, 0);
+    if (err) {
+        goto fail;
+    }
+    err = bt_le_ext_adv_start(relay_set, &start_param);
+    if (err) {
+        goto fail;
+    }
+    return 0;
+
+fail:
+    LOG_ERR("Relay advertising failed (err %d)", err);
+    atomic_clear(&relay_busy);
+    return err;
+}
+
+/*
+ * Urgent messages (button press, hard brake) skip the single-slot buffer and
+ * the scan window of the periodic stream: the event wakes a cooperative
+ * thread that starts the third set right away, with more copies. Scanning and
+ * a periodic burst may be running, the controller interleaves the sets and
+ * advertising events take precedence over the scan window.
+ */
+static struct bt_le_ext_adv *urgent_set;
+static struct adv_payload urgent_msg;
+static uint8_t urgent_buf[ADV_PAYLOAD_MAX_LEN];
+static struct bt_data urgent_ad[] = {
+    BT_DATA_BYTES(BT_DATA_FLAGS, BT_LE_AD_NO_BREDR),
+    BT_DATA(BT_DATA_MANUFACTURER_DATA, urgent_buf, ADV_PAYLOAD_ANCHOR_LEN),
+};
+static atomic_t urgent_busy = ATOMIC_INIT(0); // from the event until the last copy is sent
+static int64_t urgent_event_ticks;
+static uint8_t urgent_phy_primary = ADV_PHY_PRIMARY;
+static uint8_t urgent_phy_secondary = ADV_PHY_SECONDARY;
+static K_SEM_DEFINE(urgent_sem, 0, 1);
+
+static void urgent_sent_cb(struct bt_le_ext_adv *adv, struct bt_le_ext_adv_sent_info *info) {
+    metrics_add(METRIC_ADV_AIRTIME_US,
+                info->num_sent * adv_event_airtime_us(urgent_phy_primary, urgent_phy_secondary, 3,
+                                                      ad_total_len(urgent_ad, ARRAY_SIZE(urgent_ad))));
+    atomic_clear(&urgent_busy);
+}
+
+static struct bt_le_ext_adv_cb urgent_callbacks = {
+    .sent = urgent_sent_cb,
+};
+
+// Raise an urgent message, callable from an ISR. Events during the previous one's burst are dropped.
+void advertising_urgent(void) {
+    if (!urgent_set || !atomic_cas(&urgent_busy, 0, 1)) {
+        metrics_inc(METRIC_URGENT_DROPS);
+        return;
+    }
+    urgent_event_ticks = k_uptime_ticks();
+    k_sem_give(&urgent_sem);
+}
+
+static int urgent_send(void) {
+    struct bt_le_ext_adv_start_param start_param = {
+        .timeout = 0,
+        .num_events = URGENT_COPIES
+    };
+    struct gnss_s pos;
+
+    int err = adv_set_follow_phy(urgent_set, URGENT_ADV_INTERVAL, &urgent_phy_primary,
+                                 &urgent_phy_secondary);
+    if (err) {
+        return err;
+    }
+
+    // Self-contained: absolute position, the delta epochs belong to the periodic stream
+    position_get(&pos);
+    urgent_msg.header = NODE_ID | ADV_HDR_ANCHOR;
+    urgent_msg.number_press++;
+    urgent_msg.timestamp = get_current_time_packed();
+    urgent_msg.tx_delay = MIN(k_ticks_to_ms_floor64(k_uptime_ticks() - urgent_event_ticks), UINT8_MAX);
+    urgent_msg.latitude = pos.latitude;
+    urgent_msg.longitude = pos.longitude;
+    urgent_msg.gap_report = 0;
+    urgent_msg.hops = RELAY_MODE ? RELAY_TTL << ADV_TTL_SHIFT : 0;
+    urgent_msg.msg_type = ADV_MSG_URGENT | (ADV_CHANNELS_ALL << ADV_MSG_CHAN_SHIFT);
+    urgent_ad[AD_MFG_IDX].data_len = adv_payload_pack(&urgent_msg, urgent_buf);
+
+    err = bt_le_ext_adv_set_data(urgent_set, urgent_ad, ARRAY_SIZE(urgent_ad), NULL, 0);
+    if (err) {
+        return err;
+    }
+    return bt_le_ext_adv_start(urgent_set, &start_param);
+}
+
+static void urgent_thread(void) {
+    while (true) {
+        k_sem_take(&urgent_sem, K_FOREVER);
+
+        int err = urgent_send();
+
+        if (err) {
+            LOG_ERR("Urgent advertising failed (err %d)", err);
+            metrics_inc(METRIC_URGENT_DROPS);
+            atomic_clear(&urgent_busy);
+            continue;
+        }
+
+        // Event to first advertising event handed to the controller
+        uint32_t latency_us = k_ticks_to_us_floor32(k_uptime_ticks() - urgent_event_ticks);
+
+        metrics_inc(METRIC_URGENT_SENT);
+        metrics_set(METRIC_URGENT_LAT_US, latency_us);
+        metrics_max(METRIC_URGENT_LAT_MAX_US, latency_us);
+        LOG_INF("Urgent message %u on air %u us after the event", urgent_msg.number_press, latency_us);
+    }
+}
+
+// Cooperative priority, runs ahead of the scan parser, the SD card and the main loop
+K_THREAD_DEFINE(urgent_tid, 1024, urgent_thread, NULL, NULL, NULL, -2, 0, 0);
+
+int advertising_module_init(void) {
+    int err;
+
+    // LOG_INF("Initializing Advertising Module\n");
+
+    // Initialize the advertising data
+    struct bt_le_adv_param adv_param;
+
+    err = adv_param_build(&adv_param, adv_phy_primary, adv_phy_secondary);
+    if (err) {
+        LOG_ERR("Unsupported advertising PHY %s/%s", phy_name(adv_phy_primary),
+                phy_name(adv_phy_secondary));
+        return err;
+    }
+
+    struct bt_le_adv_param main_param = adv_param;
+
+    adv_param_channels(&main_param, adv_channels);
+    err = bt_le_ext_adv_create(&main_param, &adv_callbacks, &adv_set);
     if (err) {
         LOG_ERR("Failed to create extended advertising set (err %d)\n", err);
         return 0;
     }
 
+    if (RELAY_MODE) {
+        err = bt_le_ext_adv_create(&adv_param, &relay_callbacks, &relay_set);
+        if (err) {
+            LOG_ERR("Failed to create the relay advertising set (err %d)", err);
+            return err;
+        }
+    }
+
+    // Optional: a controller with fewer sets still sends the periodic stream, urgent events are dropped
+    struct bt_le_adv_param urgent_param = adv_param;
+
+    urgent_param.interval_min = URGENT_ADV_INTERVAL;
+    urgent_param.interval_max = URGENT_ADV_INTERVAL;
+    err = bt_le_ext_adv_create(&urgent_param, &urgent_callbacks, &urgent_set);
+    if (err) {
+        LOG_WRN("No urgent advertising set (err %d), running without urgent messages", err);
+        urgent_set = NULL;
+    }
+
+    // Flags (3) + mfg header (2) + delta payload, against the former flags + name + 20 B struct
+    LOG_INF("Payload %u B (anchor %u B), airtime per burst %u us, was %u us with the name",
+            ADV_PAYLOAD_DELTA_LEN, ADV_PAYLOAD_ANCHOR_LEN,
+            PACKET_COPIES * adv_event_airtime_us(adv_phy_primary, adv_phy_secondary,
+                                                 __builtin_popcount(adv_channels),
+                                                 3 + 2 + ADV_PAYLOAD_DELTA_LEN),
+            PACKET_COPIES * adv_event_airtime_us(adv_phy_primary, adv_phy_secondary, 3, 31));
+
     return 0;
 }
 
+#if PIGGYBACK_K
+/*
+ * Append the previous messages as deltas to the current one (at the
+ * absolute position lat/lon) and remember it for the next bursts. The
+ * history stops at the first sequence gap or delta that does not fit.
+ */
+static uint8_t piggyback_history(uint8_t *buf, uint32_t lat, uint32_t lon) {
+    struct adv_history history[PIGGYBACK_K];
+    uint32_t ts_ms = aoi_packed_to_ms(adv_mfg_data.timestamp);
+    uint8_t count;
+
+    for (count = 0; count < sent_history_count; count++) {
+        const struct sent_msg *m = &sent_history[count];
+        uint32_t dt = (ts_ms + AOI_DAY_MS - m->ts_ms) % AOI_DAY_MS;
+        int32_t dlat = (int32_t)(m->latitude - lat);
+        int32_t dlon = (int32_t)(m->longitude - lon);
+
+        if ((uint16_t)(adv_mfg_data.number_press - m->seq) != count + 1 || dt > UINT16_MAX ||
+            dlat < INT16_MIN || dlat > INT16_MAX || dlon < INT16_MIN || dlon > INT16_MAX) {
+            break;
+        }
+        history[count] = (struct adv_history){dt, dlat, dlon, m->tx_delay};
+    }
+
+    memmove(&sent_history[1], &sent_history[0], (PIGGYBACK_K - 1) * sizeof(sent_history[0]));
+    sent_history[0] = (struct sent_msg){
+        .seq = adv_mfg_data.number_press,
+        .ts_ms = ts_ms,
+        .tx_delay = adv_mfg_data.tx_delay,
+        .latitude = lat,
+        .longitude = lon,
+    };
+    sent_history_count = MIN(sent_history_count + 1, PIGGYBACK_K);
+
+    return adv_history_pack(history, count, buf);
+}
+#endif
+
+// Fill the position part of the payload: an absolute anchor every POS_ANCHOR_EVERY
+// messages (or when the offset no longer fits 16 bits), a delta to it otherwise.
+// A marker packet is sent as a zero anchor and forces a fresh anchor afterwards.
+static void set_adv_position(uint32_t lat, uint32_t lon, bool marker) {
+    int32_t dlat = (int32_t)(lat - pos_anchor_lat);
+    int32_t dlon = (int32_t)(lon - pos_anchor_lon);
+    bool anchor = marker || !pos_anchor_valid || pos_since_anchor >= POS_ANCHOR_EVERY - 1 ||
+                  dlat < INT16_MIN || dlat > INT16_MAX || dlon < INT16_MIN || dlon > INT16_MAX;
+
+    if (anchor) {
+        pos_epoch = (pos_epoch + 1) & ADV_HDR_EPOCH_MASK;
+        pos_anchor_valid = !marker;
+        pos_anchor_lat = lat;
+        pos_anchor_lon = lon;
+        pos_since_anchor = 0;
+        adv_mfg_data.latitude = lat;
+        adv_mfg_data.longitude = lon;
+    } else {
+        pos_since_anchor++;
+        adv_mfg_data.latitude = dlat;
+        adv_mfg_data.longitude = dlon;
+    }
+
+    adv_mfg_data.header = NODE_ID | (pos_epoch << ADV_HDR_EPOCH_SHIFT) |
+                          (anchor ? ADV_HDR_ANCHOR : 0);
+}
+
 int advertising_start(bool null_packet) {
     if (!packet_pending) {
         LOG_WRN("No packet available to advertise. Back to scanning mode.");
@@ -211,6 +797,11 @@ int advertising_start(bool null_packet) {
     }
     advertising_complete_flag = false;
 
+    // Before the payload, so that it advertises the channel map in use
+    if (adv_param_changed) {
+        advertising_apply_param();
+    }
+
     // congfigure the advertising data's number of copies
     struct bt_le_ext_adv_start_param start_param = {
         .timeout = 0,
@@ -218,49 +809,57 @@ int advertising_start(bool null_packet) {
     };
 
 
-    // Update adv_mfg_data with the current packet content
-    #if NLOS_TEST
-        #if ROLE
-            if (null_packet) {
-                adv_mfg_data.number_press[0] = 0;
-                adv_mfg_data.latitude[0] = 0;
-                adv_mfg_data.longitude[0] = 0;
-                adv_mfg_data.timestamp[0] = 0;
-                adv_mfg_data.tx_delay[0] = 0;
-            } else {
-                adv_mfg_data.number_press[0] = current_packet.press_count;
-                adv_mfg_data.latitude[0] = last_gnss_data.latitude;
-                adv_mfg_data.longitude[0] = last_gnss_data.longitude;
-                adv_mfg_data.timestamp[0] = get_current_time_packed();
-                adv_mfg_data.tx_delay[0] = k_uptime_get() - current_packet.tx_delay;
-            }
-        #else
-            adv_mfg_data.number_press[0] = current_packet.press_count;
-            adv_mfg_data.latitude[0] = last_gnss_data.latitude;
-            adv_mfg_data.longitude[0] = last_gnss_data.longitude;
-            adv_mfg_data.timestamp[0] = get_current_time_packed();
-            adv_mfg_data.tx_delay[0] = k_uptime_get() - current_packet.tx_delay;
-        #endif
-    #else
-        adv_mfg_data.number_press[0] = current_packet.press_count;
-        adv_mfg_data.latitude[0] = last_gnss_data.latitude;
-        adv_mfg_data.longitude[0] = last_gnss_data.longitude;
-        adv_mfg_data.timestamp[0] = get_current_time_packed();
-        adv_mfg_data.tx_delay[0] = k_uptime_get() - current_packet.tx_delay;
-    #endif        
+    #if GEN_JIT
+        current_packet.tx_delay = k_uptime_get(); // Generated now, just before the burst
+    #endif
+
+    // Update adv_mfg_data with the current packet content, NLOS masters may send a marker
+    bool marker = false;
+    #if NLOS_TEST && ROLE
+        marker = null_packet;
+    #endif
+
+    struct gnss_s pos = {0};
+
+    adv_mfg_data.msg_type = ADV_MSG_PERIODIC | (adv_channels << ADV_MSG_CHAN_SHIFT);
+    if (marker) {
+        adv_mfg_data.number_press = 0;
+        adv_mfg_data.timestamp = 0;
+        adv_mfg_data.tx_delay = 0;
+        adv_mfg_data.gap_report = 0;
+        adv_mfg_data.hops = 0;
+        set_adv_position(0, 0, true);
+    } else {
+        adv_mfg_data.number_press = current_packet.press_count;
+        adv_mfg_data.timestamp = get_current_time_packed();
+        adv_mfg_data.tx_delay = k_uptime_get() - current_packet.tx_delay;
+        adv_mfg_data.gap_report = sched_gap_report();
+        adv_mfg_data.hops = RELAY_MODE ? RELAY_TTL << ADV_TTL_SHIFT : 0;
+
+        position_get(&pos);
+        set_adv_position(pos.latitude, pos.longitude, false);
+    }
+    #if CLOCK_SYNC_BLE && CLOCK_SYNC_REFERENCE
+        // Stamped as late as possible, receivers filter the remaining latency
+        adv_mfg_data.msg_type |= ADV_MSG_SYNC;
+        adv_mfg_data.sync_us = k_ticks_to_us_floor64(k_uptime_ticks());
+    #endif
+    ad[AD_MFG_IDX].data_len = adv_payload_pack(&adv_mfg_data, adv_mfg_buf);
+    #if PIGGYBACK_K
+        if (!marker) {
+            ad[AD_MFG_IDX].data_len += piggyback_history(adv_mfg_buf + ad[AD_MFG_IDX].data_len,
+                                                         pos.latitude, pos.longitude);
+        }
+    #endif
 
     // uint32_t time =  k_uptime_get();
-    // LOG_INF("Packet value: %u / Transmission time: %u / Saved time: %u", adv_mfg_data.tx_delay[0], time, current_packet.tx_delay);
+    // LOG_INF("Packet value: %u / Transmission time: %u / Saved time: %u", adv_mfg_data.tx_delay, time, current_packet.tx_delay);
     // LOG_INF("Packet filled at: %u", time);
 
-    // Debug log to show packet content and its size
-    // LOG_INF("Advertising packet content:");
-    // LOG_INF("  Press count: %d (Size: %zu bytes)", adv_mfg_data.number_press[0], sizeof(adv_mfg_data.number_press));
-    // LOG_INF("  TX delay: %d (Size: %zu bytes)", adv_mfg_data.tx_delay[0], sizeof(adv_mfg_data.tx_delay));
-    // LOG_INF("  Latitude: %d (Size: %zu bytes)", adv_mfg_data.latitude[0], sizeof(adv_mfg_data.latitude));
-    // LOG_INF("  Longitude: %d (Size: %zu bytes)", adv_mfg_data.longitude[0], sizeof(adv_mfg_data.longitude));
-    // LOG_INF("  Timestamp: %d (Size: %zu bytes)", adv_mfg_data.timestamp[0], sizeof(adv_mfg_data.timestamp));
-    // LOG_INF("Total packet size: %zu bytes", sizeof(adv_mfg_data));
+
+    adv_event_airtime = adv_event_airtime_us(adv_phy_primary, adv_phy_secondary,
+                                             __builtin_popcount(adv_channels),
+                                             ad_total_len(ad, ARRAY_SIZE(ad)));
 
     int err = bt_le_ext_adv_set_data(adv_set, ad, ARRAY_SIZE(ad), NULL, 0);
     if (err) {
@@ -274,18 +873,175 @@ int advertising_start(bool null_packet) {
         LOG_ERR("Failed to start advertising (err %d)", err);
         return err;
     }
+    TRACE(TRACE_ADV_START, adv_mfg_data.number_press);
     // time =  k_uptime_get();
     // LOG_INF("Packet sent at: %u", time);
 
+    if (!first_adv_done) {
+        first_adv_done = true;
+        LOG_INF("Boot to first advertisement: %u ms", k_uptime_get_32());
+    }
+
     return 0;
 }
 
+#if CLOCK_SYNC_BLE && CLOCK_SYNC_REFERENCE
+// One sync-only event between the tests, a marker message that carries the reference time
+int advertising_sync_beacon(void) {
+    struct bt_le_ext_adv_start_param start_param = {
+        .timeout = 0,
+        .num_events = 1
+    };
+
+    if (!advertising_complete_flag) {
+        return 0; // The last burst of the test is still on air
+    }
+    advertising_complete_flag = false;
+
+    adv_mfg_data.msg_type = ADV_MSG_PERIODIC | (adv_channels << ADV_MSG_CHAN_SHIFT) | ADV_MSG_SYNC;
+    adv_mfg_data.number_press = 0;
+    adv_mfg_data.timestamp = 0;
+    adv_mfg_data.tx_delay = 0;
+    adv_mfg_data.gap_report = 0;
+    adv_mfg_data.hops = 0;
+    set_adv_position(0, 0, true);
+    adv_mfg_data.sync_us = k_ticks_to_us_floor64(k_uptime_ticks());
+    ad[AD_MFG_IDX].data_len = adv_payload_pack(&adv_mfg_data, adv_mfg_buf);
+
+    int err = bt_le_ext_adv_set_data(adv_set, ad, ARRAY_SIZE(ad), NULL, 0);
+    if (!err) {
+        err = bt_le_ext_adv_start(adv_set, &start_param);
+    }
+    if (err) {
+        advertising_complete_flag = true;
+        LOG_WRN("Sync beacon not sent (err %d)", err);
+    }
+    return err;
+}
+#endif
+
 int advertising_stop(void) {
     // Stop the advertising
     // LOG_INF("Advertising stopped successfully.");
     advertising_complete_flag = true;
     update_availability_flag = false; // Reset availability after advertising
     packet_pending = false; // Mark packet as processed
+    k_sem_reset(&packet_ready_sem);
+
+    return 0;
+}
+
+#if defined(CONFIG_SHELL)
+
+static int parse_phy(const char *arg, uint8_t *phy) {
+    if (strcmp(arg, "1m") == 0) {
+        *phy = BT_GAP_LE_PHY_1M;
+    } else if (strcmp(arg, "2m") == 0) {
+        *phy = BT_GAP_LE_PHY_2M;
+    } else if (strcmp(arg, "coded") == 0) {
+        *phy = BT_GAP_LE_PHY_CODED;
+    } else {
+        return -EINVAL;
+    }
+    return 0;
+}
+
+static int cmd_adv_phy(const struct shell *sh, size_t argc, char **argv) {
+    uint8_t primary;
+    uint8_t secondary;
+
+    if (parse_phy(argv[1], &primary) || parse_phy(argv[2], &secondary)) {
+        shell_error(sh, "PHY must be 1m, 2m or coded");
+        return -EINVAL;
+    }
+    if (advertising_set_phy(primary, secondary)) {
+        shell_error(sh, "Supported: 1m 1m, 1m 2m, coded coded");
+        return -ENOTSUP;
+    }
+    shell_print(sh, "Advertising PHY %s/%s from the next burst", phy_name(primary),
+                phy_name(secondary));
+    return 0;
+}
+
+static int cmd_adv_chan(const struct shell *sh, size_t argc, char **argv) {
+    uint8_t channels = 0;
+
+    for (size_t i = 1; i < argc; i++) {
+        int chan = strtol(argv[i], NULL, 10);
+
+        if (chan < 37 || chan > 39) {
+            shell_error(sh, "Channels are 37, 38 and 39");
+            return -EINVAL;
+        }
+        channels |= BIT(chan - 37);
+    }
+    advertising_set_channels(channels);
+    shell_print(sh, "Advertising on %s from the next burst", adv_channels_name(channels));
+    return 0;
+}
+
+static int cmd_adv_urgent(const struct shell *sh, size_t argc, char **argv) {
+    advertising_urgent();
+    shell_print(sh, "Urgent message raised");
+    return 0;
+}
+
+/*
+ * Copies against piggybacking, for independent losses of loss % per
+ * advertising event: a message arrives if any copy of its own burst or of
+ * the K following bursts does. Airtime is per message on the current PHY.
+ */
+static int cmd_adv_redundancy(const struct shell *sh, size_t argc, char **argv) {
+    int loss = strtol(argv[1], NULL, 10);
+
+    if (loss < 0 || loss > 100) {
+        shell_error(sh, "Loss is a percentage");
+        return -EINVAL;
+    }
+
+    shell_print(sh, "copies  K  delivery   airtime");
+    for (int copies = 1; copies <= PACKET_COPIES; copies++) {
+        double burst_loss = 1;
+
+        for (int i = 0; i < copies; i++) {
+            burst_loss *= loss / 100.0;
+        }
+        for (int k = 0; k <= 3; k++) {
+            bool legacy = adv_phy_primary == BT_GAP_LE_PHY_1M &&
+                          adv_phy_secondary == BT_GAP_LE_PHY_1M && k == 0;
+            uint16_t ad_len = 3 + 2 + ADV_PAYLOAD_DELTA_LEN + k * ADV_HISTORY_ENTRY_LEN;
+            double lost = burst_loss;
+
+            for (int i = 0; i < k; i++) {
+                lost *= burst_loss;
+            }
+            shell_print(sh, "%6d %2d %6u.%01u%% %6u us", copies, k,
+                        (uint32_t)((1 - lost) * 1000) / 10, (uint32_t)((1 - lost) * 1000) % 10,
+                        copies * event_airtime_us(legacy, adv_phy_primary, adv_phy_secondary,
+                                                  __builtin_popcount(adv_channels), ad_len));
+        }
+    }
+    return 0;
+}
+
+static int cmd_adv_shift(const struct shell *sh, size_t argc, char **argv) {
+    int32_t shift_ms = strtol(argv[1], NULL, 10);
 
+    generation_shift_phase(shift_ms);
+    shell_print(sh, "Generation phase %d ms", gen_phase_ms);
     return 0;
 }
+
+SHELL_STATIC_SUBCMD_SET_CREATE(adv_cmds,
+    SHELL_CMD_ARG(phy, NULL, "<primary> <secondary>: 1m, 2m or coded", cmd_adv_phy, 3, 0),
+    SHELL_CMD_ARG(shift, NULL, "<ms>: move the generation deadlines", cmd_adv_shift, 2, 0),
+    SHELL_CMD_ARG(chan, NULL, "<37|38|39>...: primary advertising channels", cmd_adv_chan, 2, 2),
+    SHELL_CMD(urgent, NULL, "Send an urgent message now", cmd_adv_urgent),
+    SHELL_CMD_ARG(redundancy, NULL, "<loss %>: delivery and airtime of copies vs piggybacking",
+                  cmd_adv_redundancy, 2, 0),
+    SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(adv, &adv_cmds, "Advertising settings", NULL);
+
+#endif
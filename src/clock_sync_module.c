@@ -0,0 +1,189 @@
+#include <stdlib.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include "clock_sync_module.h"
+#include "beacon_module.h"
+#include "metrics_module.h"
+
+LOG_MODULE_REGISTER(clock_sync_module, LOG_LEVEL_INF);
+
+/*
+ * Over-the-air clock sync. The reference stamps its uptime in us into its
+ * advertisements right before handing them to the controller, so a receiver
+ * sees rx - tx = clock offset + send/receive latency. The latency is never
+ * negative and has a sharp floor: each CLOCK_SYNC_BLOCK_MS of beacons is
+ * reduced to its smallest rx - tx (the lower envelope) and a least squares
+ * line through the last CLOCK_SYNC_POINTS minima gives offset and skew. The
+ * mean absolute residual of the minima around the line is the sync error.
+ */
+struct sync_point {
+    int64_t rx_us;      // local uptime
+    int64_t offset_us;  // local minus reference
+};
+
+static struct sync_point sync_points[CLOCK_SYNC_POINTS];
+static int sync_point_count;
+static int sync_point_next;
+
+static bool block_open;
+static int64_t block_start_us;
+static struct sync_point block_min;
+
+static bool ref_seen;
+static int64_t ref_ext_us; // last reference timestamp with its 32-bit wraps counted
+
+// offset(t) = fit_offset_us + fit_skew * (t - fit_x0_us)
+static bool fit_valid;
+static int64_t fit_x0_us;
+static double fit_offset_us;
+static double fit_skew;
+static uint32_t fit_err_us;
+static struct k_spinlock sync_lock;
+
+static double fit_offset_at(int64_t local_us) {
+    return fit_offset_us + fit_skew * (double)(local_us - fit_x0_us);
+}
+
+// Least squares over the stored minima, centred on their mean to keep the doubles small
+static void sync_fit(void) {
+    int oldest = (sync_point_next - sync_point_count + CLOCK_SYNC_POINTS) % CLOCK_SYNC_POINTS;
+    int64_t x0 = sync_points[oldest].rx_us;
+    int64_t y0 = sync_points[oldest].offset_us;
+    double mx = 0, my = 0, sxx = 0, sxy = 0, err = 0;
+
+    for (int i = 0; i < sync_point_count; i++) {
+        mx += sync_points[i].rx_us - x0;
+        my += sync_points[i].offset_us - y0;
+    }
+    mx /= sync_point_count;
+    my /= sync_point_count;
+
+    for (int i = 0; i < sync_point_count; i++) {
+        double dx = (sync_points[i].rx_us - x0) - mx;
+        double dy = (sync_points[i].offset_us - y0) - my;
+
+        sxx += dx * dx;
+        sxy += dx * dy;
+    }
+
+    fit_skew = sxx > 0 ? sxy / sxx : 0;
+    fit_x0_us = x0 + (int64_t)mx;
+    fit_offset_us = y0 + my;
+
+    for (int i = 0; i < sync_point_count; i++) {
+        double r = sync_points[i].offset_us - fit_offset_at(sync_points[i].rx_us);
+
+        err += r < 0 ? -r : r;
+    }
+    fit_err_us = err / sync_point_count;
+    fit_valid = sync_point_count >= CLOCK_SYNC_MIN_POINTS;
+}
+
+void clock_sync_observe(uint32_t ref_us, int64_t rx_us) {
+    k_spinlock_key_t key = k_spin_lock(&sync_lock);
+
+    ref_ext_us = ref_seen ? ref_ext_us + (int32_t)(ref_us - (uint32_t)ref_ext_us) : ref_us;
+    ref_seen = true;
+
+    struct sync_point s = {
+        .rx_us = rx_us,
+        .offset_us = rx_us - ref_ext_us - CLOCK_SYNC_FIXED_DELAY_US,
+    };
+
+    // A jump of more than a second means the reference restarted, start over
+    if (fit_valid && llabs(s.offset_us - (int64_t)fit_offset_at(rx_us)) > 1000000) {
+        ref_ext_us = ref_us;
+        s.offset_us = rx_us - ref_ext_us - CLOCK_SYNC_FIXED_DELAY_US;
+        sync_point_count = 0;
+        sync_point_next = 0;
+        block_open = false;
+        fit_valid = false;
+    }
+
+    if (block_open && rx_us - block_start_us >= CLOCK_SYNC_BLOCK_MS * 1000LL) {
+        sync_points[sync_point_next] = block_min;
+        sync_point_next = (sync_point_next + 1) % CLOCK_SYNC_POINTS;
+        sync_point_count = MIN(sync_point_count + 1, CLOCK_SYNC_POINTS);
+        block_open = false;
+        sync_fit();
+        metrics_set(METRIC_CLOCK_SYNC_ERR_US, fit_err_us);
+    }
+
+    if (!block_open) {
+        block_open = true;
+        block_start_us = rx_us;
+        block_min = s;
+    } else if (s.offset_us < block_min.offset_us) {
+        block_min = s;
+    }
+
+    k_spin_unlock(&sync_lock, key);
+    metrics_inc(METRIC_CLOCK_SYNC_BEACONS);
+}
+
+bool clock_sync_ready(void) {
+    return CLOCK_SYNC_REFERENCE || fit_valid;
+}
+
+uint32_t clock_sync_ms(uint32_t local_ms) {
+    if (!CLOCK_SYNC_BLE || CLOCK_SYNC_REFERENCE) {
+        return local_ms;
+    }
+
+    k_spinlock_key_t key = k_spin_lock(&sync_lock);
+    int64_t offset_ms = fit_valid ? (int64_t)fit_offset_at(local_ms * 1000LL) / 1000 : 0;
+
+    k_spin_unlock(&sync_lock, key);
+    return local_ms - (uint32_t)offset_ms;
+}
+
+/*
+ * Tests start at CLOCK_SYNC_START_MS + k * CLOCK_SYNC_EPOCH_MS of the
+ * reference clock. A follower that syncs late joins at a later epoch but
+ * its test windows still coincide with the reference's. The tests carry
+ * the sync stamp, in between the reference sends sync beacons of its own,
+ * starting with the wait for the first test.
+ */
+BUILD_ASSERT(CLOCK_SYNC_START_MS > CLOCK_SYNC_LEAD_MS, "no follower can sync before the first test");
+
+void clock_sync_align(void) {
+    uint32_t now = clock_sync_ms(k_uptime_get_32());
+    uint32_t wait = now < CLOCK_SYNC_START_MS ? CLOCK_SYNC_START_MS - now :
+                    CLOCK_SYNC_EPOCH_MS - (now - CLOCK_SYNC_START_MS) % CLOCK_SYNC_EPOCH_MS;
+
+#if CLOCK_SYNC_BLE && CLOCK_SYNC_REFERENCE
+    static bool beaconing;
+
+    if (!beaconing) {
+        beaconing = true;
+        while (wait < CLOCK_SYNC_LEAD_MS) {
+            wait += CLOCK_SYNC_EPOCH_MS;
+        }
+    }
+#endif
+    uint32_t epoch = (now + wait - CLOCK_SYNC_START_MS) / CLOCK_SYNC_EPOCH_MS;
+
+    if (!CLOCK_SYNC_REFERENCE) {
+        k_spinlock_key_t key = k_spin_lock(&sync_lock);
+        int64_t offset_us = fit_offset_at(k_ticks_to_us_floor64(k_uptime_ticks()));
+        int32_t skew_ppb = fit_skew * 1e9;
+        uint32_t err_us = fit_err_us;
+        int points = sync_point_count;
+
+        k_spin_unlock(&sync_lock, key);
+        LOG_INF("Clock sync: offset %lld us, skew %d ppb, error %u us over %d blocks", (long long)offset_us,
+                skew_ppb, err_us, points);
+    }
+    LOG_INF("Test epoch %u starts in %u ms", epoch, wait);
+
+#if CLOCK_SYNC_BLE && CLOCK_SYNC_REFERENCE
+    int64_t start = k_uptime_get() + wait;
+
+    for (int64_t left = wait; left > 0; left = start - k_uptime_get()) {
+        advertising_sync_beacon();
+        k_sleep(K_MSEC(MIN(left, CLOCK_SYNC_BEACON_MS)));
+    }
+#else
+    k_sleep(K_MSEC(wait));
+#endif
+}
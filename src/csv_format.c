@@ -0,0 +1,205 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <zephyr/sys/crc.h>
+#include "csv_format.h"
+
+/* "00".."99" lookup table used by the row encoder below */
+static const char digit_pairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+/* Plain %u */
+static char *put_uint(char *p, uint32_t value)
+{
+    char tmp[10];
+    char *t = tmp + sizeof(tmp);
+
+    while (value >= 100) {
+        uint32_t pair = value % 100;
+
+        value /= 100;
+        t -= 2;
+        memcpy(t, &digit_pairs[pair * 2], 2);
+    }
+    if (value >= 10) {
+        t -= 2;
+        memcpy(t, &digit_pairs[value * 2], 2);
+    } else {
+        *--t = '0' + value;
+    }
+
+    size_t len = tmp + sizeof(tmp) - t;
+
+    memcpy(p, t, len);
+    return p + len;
+}
+
+/* %02u, falls back to put_uint() when the value does not fit */
+static inline char *put_uint2(char *p, uint32_t value)
+{
+    if (value >= 100) {
+        return put_uint(p, value);
+    }
+    memcpy(p, &digit_pairs[value * 2], 2);
+    return p + 2;
+}
+
+/* %03u, falls back to put_uint() when the value does not fit */
+static inline char *put_uint3(char *p, uint32_t value)
+{
+    if (value >= 1000) {
+        return put_uint(p, value);
+    }
+    *p++ = '0' + value / 100;
+    memcpy(p, &digit_pairs[(value % 100) * 2], 2);
+    return p + 2;
+}
+
+static inline char *put_hex2(char *p, uint8_t value)
+{
+    static const char hex[] = "0123456789ABCDEF";
+
+    *p++ = hex[value >> 4];
+    *p++ = hex[value & 0xF];
+    return p;
+}
+
+/* Plain %d */
+static inline char *put_int(char *p, int32_t value)
+{
+    if (value < 0) {
+        *p++ = '-';
+        return put_uint(p, 0U - (uint32_t)value);
+    }
+    return put_uint(p, value);
+}
+
+/*
+ * Encode one CSV row without going through snprintf. The output is byte for
+ * byte what
+ * "%02u%02u%02u%03u,%02u:%02u:%02u.%03u,%u,%02u:%02u:%02u.%03u,%u,%u,%u,%d,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%d,%u,%u\n"
+ * produces, plus a CRC-8 column when CSV_ROW_CHECKSUM is set. The tx time is
+ * encoded once and copied into the second column.
+ * The buffer must hold at least CSV_ROW_MAX_LEN bytes. Returns the row length.
+ */
+int csv_format_row(char *buf, const struct packet_data *pkt)
+{
+    char *p = buf;
+
+    /* timestamp_id */
+    char *hour = p;
+    p = put_uint2(p, pkt->tx_hour);
+    char *minute = p;
+    p = put_uint2(p, pkt->tx_minute);
+    char *second = p;
+    p = put_uint2(p, pkt->tx_second);
+    char *ms = p;
+    p = put_uint3(p, pkt->tx_ms);
+    char *end = p;
+    *p++ = ',';
+
+    /* timestamp_tx, reusing the digits of timestamp_id */
+    memcpy(p, hour, minute - hour);
+    p += minute - hour;
+    *p++ = ':';
+    memcpy(p, minute, second - minute);
+    p += second - minute;
+    *p++ = ':';
+    memcpy(p, second, ms - second);
+    p += ms - second;
+    *p++ = '.';
+    memcpy(p, ms, end - ms);
+    p += end - ms;
+    *p++ = ',';
+
+    p = put_uint(p, pkt->tx_delay);
+    *p++ = ',';
+
+    /* timestamp_rx */
+    p = put_uint2(p, pkt->rx_hour);
+    *p++ = ':';
+    p = put_uint2(p, pkt->rx_minute);
+    *p++ = ':';
+    p = put_uint2(p, pkt->rx_second);
+    *p++ = '.';
+    p = put_uint3(p, pkt->rx_ms);
+    *p++ = ',';
+
+    p = put_uint(p, pkt->number_press);
+    *p++ = ',';
+    p = put_uint(p, pkt->latitude);
+    *p++ = ',';
+    p = put_uint(p, pkt->longitude);
+    *p++ = ',';
+    p = put_int(p, pkt->rssi);
+    *p++ = ',';
+    p = put_uint(p, pkt->aoi);
+    *p++ = ',';
+    p = put_uint(p, pkt->copies);
+    *p++ = ',';
+    p = put_uint(p, pkt->copy_spread);
+    *p++ = ',';
+    p = put_uint(p, pkt->hops);
+    *p++ = ',';
+    p = put_uint(p, pkt->origin);
+    *p++ = ',';
+    p = put_uint(p, pkt->msg_type);
+    *p++ = ',';
+    p = put_uint(p, pkt->chan_map);
+    *p++ = ',';
+    p = put_uint(p, pkt->primary_phy);
+    *p++ = ',';
+    p = put_uint(p, pkt->secondary_phy);
+    *p++ = ',';
+    p = put_uint(p, pkt->sid);
+    *p++ = ',';
+    p = put_int(p, pkt->tx_power);
+    *p++ = ',';
+    p = put_uint(p, pkt->truncated);
+    *p++ = ',';
+    p = put_uint(p, pkt->recovered);
+
+#if CSV_ROW_CHECKSUM
+    /* CRC-8 of everything before the checksum column */
+    uint8_t crc = crc8_ccitt(0, buf, p - buf);
+
+    *p++ = ',';
+    p = put_hex2(p, crc);
+#endif
+    *p++ = '\n';
+
+    return p - buf;
+}
+
+/* Check a row (without its newline) against its trailing checksum column */
+bool csv_row_valid(const char *line, size_t len)
+{
+#if CSV_ROW_CHECKSUM
+    unsigned int crc;
+    char hex[3];
+
+    if (len < 3 || line[len - 3] != ',') {
+        return false;
+    }
+    memcpy(hex, &line[len - 2], 2);
+    hex[2] = '\0';
+    if (sscanf(hex, "%2X", &crc) != 1) {
+        return false;
+    }
+    return crc8_ccitt(0, line, len - 3) == crc;
+#else
+    return len > 0;
+#endif
+}
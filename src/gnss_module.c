@@ -5,6 +5,7 @@
 // #include <dk_buttons_and_leds.h>
 #include <zephyr/logging/log.h>
 #include "gnss_module.h" // Include the header file for GNSS functionality
+#include "position_module.h"
 
 LOG_MODULE_REGISTER(GNSS_module, LOG_LEVEL_INF); // Use the same logging module
 
@@ -13,8 +14,7 @@ static bool first_fix = false;  // Flag for first fix
 static gnss_fix_callback_t fix_cb;  // Callback for first fix
 
 // Structure to hold current RTC time
-struct rtc_time_s rtc_time;
-struct gnss_s last_gnss_data = {52243187,6856186};
+static struct rtc_time_s rtc_time;
 
 // GNSS event handler
 static void gnss_event_handler(int event) {
@@ -91,12 +91,14 @@ void update_rtc_from_gnss(void) {
     rtc_time.second = pvt_data.datetime.seconds;
     rtc_time.ms = pvt_data.datetime.ms;
 
-    // Store the latest latitude and longitude in the gnss_data structure
-    last_gnss_data.latitude = (uint32_t)(pvt_data.latitude * 1000000);
-    last_gnss_data.longitude = (uint32_t)(pvt_data.longitude * 1000000);
+    // Publish the latest latitude and longitude for the advertiser
+    int32_t latitude = (int32_t)(pvt_data.latitude * 1000000);
+    int32_t longitude = (int32_t)(pvt_data.longitude * 1000000);
 
-    LOG_INF("RTC updated from GNSS: %02u:%02u:%02u.%03u - Coordinates: %u, %u", 
-            rtc_time.hour, rtc_time.minute, rtc_time.second, rtc_time.ms, last_gnss_data.latitude, last_gnss_data.longitude);
+    position_publish((uint32_t)latitude, (uint32_t)longitude);
+
+    LOG_INF("RTC updated from GNSS: %02u:%02u:%02u.%03u - Coordinates: %d, %d", 
+            rtc_time.hour, rtc_time.minute, rtc_time.second, rtc_time.ms, latitude, longitude);
 
     // dk_set_led_on(DK_LED1); // Indicate fix acquisition with LED
 }
@@ -10,6 +10,13 @@
 #include "ble_settings.h"
 #include "sdcard_module.h"
 #include "uart_module.h"
+#include "metrics_module.h"
+#include "trace_module.h"
+#include "position_module.h"
+#include "aoi_module.h"
+#include "sched_module.h"
+#include "relay_module.h"
+#include "clock_sync_module.h"
 
 LOG_MODULE_REGISTER(main_logging, LOG_LEVEL_INF); // Register the logging module
 
@@ -125,10 +132,6 @@ void error_callback(const char *error_message)
             k_timer_start(&led_timer, K_MSEC(100), K_NO_WAIT);  // Reset the timer (1 second)
         }
 
-        // #if ROLE
-            static bool first_test = true;
-        // #endif
-
         static bool recording_status = false;
 
         #define DEBOUNCE_DELAY_MS 500
@@ -144,6 +147,7 @@ void error_callback(const char *error_message)
                     // #if ROLE
                     if (recording_status) {
                         LOG_INF("Stop recording");
+                        dedup_flush_all();
                         append_stop();
                         switch_recording(false);
                         gpio_pin_configure_dt(&led2, GPIO_OUTPUT_INACTIVE);
@@ -159,6 +163,8 @@ void error_callback(const char *error_message)
                     //     gpio_pin_toggle_dt(&led2);
                     //     LOG_INF("Button pressed");
                     // #endif
+                #else
+                    advertising_urgent();
                 #endif
             }
         }
@@ -186,6 +192,9 @@ void error_callback(const char *error_message)
 int main(void) {
     int err;
     LOG_INF("Starting B2B device...");
+    metrics_init();
+    trace_init();
+    position_init();
 
     #if !defined(CONFIG_BOARD_NRF9160DK_NRF52840)
         // initialize the GPIO pins
@@ -224,16 +233,11 @@ int main(void) {
                 // Register the error callback with the SD card module
                 set_error_handler(error_callback);
 
-                // Initialize the SD card
-                err = sdcard_init();
-                if (err) {
-                    LOG_ERR("Failed to initialize SD Card, error: %d", err);
-                    return 0;
-                } else {
-                    create_csv();
-                } 
+                // Mount the SD card and create the test file in the background,
+                // records are buffered until it is ready
+                sdcard_init_async();
 
-                append_csv(0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0); 
+                append_null(); 
             #endif
             #if !ROLE
                 // Configure sync pin (input with pull-up) and interrupt for rising edge
@@ -251,19 +255,6 @@ int main(void) {
         
     #endif
 
-    // Initialize the GNSS module
-    // err = nrf_modem_lib_init();
-    // if (err) {
-    //     LOG_ERR("Failed to initialize modem, error: %d", err);
-    //     return -1;
-    // }
-
-    // // Setup GNSS with the first-fix callback
-    // if (setup_gnss(on_first_fix_acquired) != 0) {
-    //     LOG_ERR("GNSS setup failed");
-    //     return -1;
-    // }
-
     // Main loop
     while (true) {
         switch (current_state) {
@@ -299,7 +290,7 @@ int main(void) {
                 // keep scanning if no available data to send
                 while (!check_update_availability()) {
                     // LOG_INF("Scan interval reset due to no data to send. \n");
-                    k_sleep(K_MSEC(SCAN_WINDOW_MAIN));
+                    wait_update_availability(K_MSEC(SCAN_WINDOW_MAIN));
                     // scan_duration = scan_duration + SCAN_WINDOW_MAIN;
                     #if !defined(CONFIG_BOARD_NRF9160DK_NRF52840)
                         if (is_packet_received()) {
@@ -308,6 +299,18 @@ int main(void) {
                     #endif
                 }
 
+                // Keep listening while a peer is predicted to be on air
+                uint32_t hold = sched_adv_delay(k_uptime_get_32());
+                if (hold) {
+                    k_sleep(K_MSEC(hold));
+                }
+                #if SLOTTED_ADV
+                    // Generate just ahead of our slot from now on instead of waiting for it
+                    if (hold > SLOT_GEN_LEAD_MS) {
+                        generation_shift_phase(hold - SLOT_GEN_LEAD_MS);
+                    }
+                #endif
+
                 int err = bt_le_scan_stop();
                 if (err) {
                     LOG_ERR("Stopping scanning failed (err %d)\n", err);
@@ -396,6 +399,9 @@ int main(void) {
                     LOG_ERR("Advertising module init failed");
                     return err;
                 }
+                #if RELAY_MODE
+                    relay_init();
+                #endif
                 
                 LOG_INF("Bluetooth initialized");
                 LOG_INF("Msg generation: %d ms / Number of copies: %d / Scan Window: %d ms / Test: %s / Time shift: %d ms / Role: %d", 
@@ -412,6 +418,24 @@ int main(void) {
             #if !defined(CONFIG_BOARD_NRF9160DK_NRF52840)
                 // UART sychronization
                 case STATE_UART_SYNC:
+                    #if CLOCK_SYNC_BLE
+                        // No wire: followers listen to the reference until its clock is estimated,
+                        // then every node starts on the same boundary of the reference clock
+                        #if !CLOCK_SYNC_REFERENCE
+                            if (!clock_sync_ready()) {
+                                LOG_INF("Waiting for the clock sync reference...");
+                                err = ble_start_scanning();
+                                if (err) {
+                                    return err;
+                                }
+                                while (!clock_sync_ready()) {
+                                    k_sleep(K_MSEC(100));
+                                }
+                                bt_le_scan_stop();
+                            }
+                        #endif
+                        clock_sync_align();
+                    #else
                     LOG_INF("Start UART sychronization");
                     err = uart_init();
                     if (err) {
@@ -426,6 +450,7 @@ int main(void) {
                         LOG_INF("Searching for master...");
                         wait_for_response("HELLO");
                     #endif
+                    #endif
                     
                     #if NLOS_TEST
                         switch_recording(false);
@@ -438,16 +463,6 @@ int main(void) {
                             #if !(NLOS_TEST)
                                 k_timer_init(&timeout_timer, timer_handler, NULL);
                                 // k_timer_start(&timeout_timer, K_SECONDS(RUNAWAY_PERIOD), K_SECONDS(TEST_PERIOD));
-                                #if ROLE
-                                if (first_test) {
-                                    first_test = false;
-                                } else {
-                                    LOG_INF("Time %u shift added",TEST_SHIFT*test_count);
-                                    // trigger_time_shift();
-                                    k_sleep(K_MSEC(TEST_SHIFT*test_count));
-                                }
-
-                                #endif
                                 k_timer_start(&timeout_timer, K_SECONDS(TEST_PERIOD), K_NO_WAIT);
                             #endif
                         // #endif
@@ -455,7 +470,13 @@ int main(void) {
                         gpio_pin_configure_dt(&led3, GPIO_OUTPUT_INACTIVE);
                     #endif
 
-                    reset_last_packet_time();
+                    aoi_window_restart();
+                    scan_channel_stats_restart();
+                    scan_census_restart();
+
+                    #if CHANNEL_BENCH
+                        advertising_channel_bench_next();
+                    #endif
 
                     // LOG_INF("App starting...");
                     err = application_init();
@@ -464,6 +485,15 @@ int main(void) {
                         return err;
                     }
 
+                    #if ROLE && !(NLOS_TEST)
+                        // Both nodes start the test on the sync point, only the generation of
+                        // this one is offset by a further TEST_SHIFT on every test
+                        if (test_count > 0) {
+                            generation_shift_phase(TEST_SHIFT * test_count);
+                            LOG_INF("Time %u shift added", TEST_SHIFT * test_count);
+                        }
+                    #endif
+
                     // LOG_INF("Msg generation: %d ms / Number of copies: %d / Scan Window: %d ms / Test: %s / Time shift: %d ms / Role: %d", 
                     // INTERVAL, PACKET_COPIES,SCAN_WINDOW_MAIN,CSV_TEST_NAME, TEST_SHIFT,ROLE);
 
@@ -474,8 +504,9 @@ int main(void) {
                 // Add marker packet to the SD card and shift
                 case STATE_NEW_TEST_FILE:
                     #if ROLE
+                    dedup_flush_all();
                     append_null();
-                    reset_last_packet_time();
+                    aoi_window_restart();
                     #endif
                     k_timer_stop(&timeout_timer);
 
@@ -486,12 +517,6 @@ int main(void) {
                     }
                     #if ROLE
                     switch_recording(false);
-                    // if (first_test) {
-                    //     first_test = false;
-                    // } else {
-                    //     trigger_time_shift();
-                    //     LOG_INF("Time shift added at: %lld", k_uptime_get());
-                    // }  
                     #endif
 
                     
@@ -0,0 +1,104 @@
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/shell/shell.h>
+#include "metrics_module.h"
+
+LOG_MODULE_REGISTER(metrics_module, LOG_LEVEL_INF);
+
+atomic_t metrics[METRIC_COUNT];
+
+#define METRICS_NAME(id, name) name,
+static const char *const metric_names[METRIC_COUNT] = {
+    METRICS_LIST(METRICS_NAME)
+};
+#undef METRICS_NAME
+
+static struct k_work_delayable metrics_log_work;
+
+void metrics_reset(void) {
+    for (int i = 0; i < METRIC_COUNT; i++) {
+        atomic_clear(&metrics[i]);
+    }
+}
+
+// One compact line with the pipeline counters
+void metrics_log(void) {
+    uint32_t writes = metrics_get(METRIC_SD_WRITES);
+
+    LOG_INF("stats scan %u/%u slab drop %u q %u/%u drop %u sd %u rows %u wr avg %u max %u us adv %u/%u gdrop %u aoi %u/%u ms bg %u/%u",
+            metrics_get(METRIC_SCAN_ACCEPTED), metrics_get(METRIC_SCAN_SEEN),
+            metrics_get(METRIC_SCAN_SLAB_DROPS),
+            metrics_get(METRIC_QUEUE_DEPTH), metrics_get(METRIC_QUEUE_PEAK),
+            metrics_get(METRIC_QUEUE_DROPS), metrics_get(METRIC_SD_ROWS), writes,
+            writes ? metrics_get(METRIC_SD_WRITE_US) / writes : 0,
+            metrics_get(METRIC_SD_WRITE_MAX_US),
+            metrics_get(METRIC_ADV_BURSTS), metrics_get(METRIC_ADV_COPIES),
+            metrics_get(METRIC_GEN_DROPS), metrics_get(METRIC_AOI_AVG_MS),
+            metrics_get(METRIC_AOI_PEAK_MS), metrics_get(METRIC_CENSUS_REPORTS),
+            metrics_get(METRIC_CENSUS_DEVICES));
+}
+
+static void metrics_log_handler(struct k_work *work) {
+    metrics_log();
+    k_work_reschedule(&metrics_log_work, K_MSEC(METRICS_LOG_INTERVAL));
+}
+
+int metrics_init(void) {
+    k_work_init_delayable(&metrics_log_work, metrics_log_handler);
+    if (METRICS_LOG_INTERVAL > 0) {
+        k_work_reschedule(&metrics_log_work, K_MSEC(METRICS_LOG_INTERVAL));
+    }
+    return 0;
+}
+
+#if defined(CONFIG_SHELL)
+
+static void print_thread(const struct k_thread *cthread, void *user_data) {
+    const struct shell *sh = user_data;
+    struct k_thread *thread = (struct k_thread *)cthread;
+    k_thread_runtime_stats_t rt_stats;
+    k_thread_runtime_stats_t all_stats;
+    size_t unused = 0;
+    const char *name = k_thread_name_get(thread);
+
+    k_thread_runtime_stats_get(thread, &rt_stats);
+    k_thread_runtime_stats_all_get(&all_stats);
+    k_thread_stack_space_get(thread, &unused);
+
+    uint32_t cpu_permille = all_stats.execution_cycles ?
+        (uint32_t)(rt_stats.execution_cycles * 1000 / all_stats.execution_cycles) : 0;
+
+    shell_print(sh, "%-20s cpu %3u.%u%%  stack %4u/%4u used",
+                (name && name[0]) ? name : "(unnamed)", cpu_permille / 10, cpu_permille % 10,
+                thread->stack_info.size - unused, thread->stack_info.size);
+}
+
+static int cmd_stats_show(const struct shell *sh, size_t argc, char **argv) {
+    for (int i = 0; i < METRIC_COUNT; i++) {
+        shell_print(sh, "%-16s %u", metric_names[i], metrics_get(i));
+    }
+    return 0;
+}
+
+static int cmd_stats_threads(const struct shell *sh, size_t argc, char **argv) {
+    // print_thread blocks on the shell transport, the locked variant would hold interrupts off meanwhile
+    k_thread_foreach_unlocked(print_thread, (void *)sh);
+    return 0;
+}
+
+static int cmd_stats_reset(const struct shell *sh, size_t argc, char **argv) {
+    metrics_reset();
+    shell_print(sh, "Stats reset");
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(stats_cmds,
+    SHELL_CMD(show, NULL, "Pipeline counters and gauges", cmd_stats_show),
+    SHELL_CMD(threads, NULL, "Per-thread CPU usage and stack high-water marks", cmd_stats_threads),
+    SHELL_CMD(reset, NULL, "Clear all counters and gauges", cmd_stats_reset),
+    SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(stats, &stats_cmds, "B2B runtime statistics", cmd_stats_show);
+
+#endif
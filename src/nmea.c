@@ -0,0 +1,89 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <zephyr/sys/util.h>
+#include "nmea.h"
+
+// Verify the *hh checksum and cut it off
+bool nmea_checksum_ok(char *line) {
+    char *star = strchr(line, '*');
+    uint8_t sum = 0;
+
+    if (line[0] != '$' || !star) {
+        return false;
+    }
+    for (const char *c = line + 1; c < star; c++) {
+        sum ^= *c;
+    }
+    *star = '\0';
+    return strtoul(star + 1, NULL, 16) == sum;
+}
+
+// ddmm.mmmm / dddmm.mmmm and hemisphere to micro-degrees
+int32_t nmea_coord(const char *value, const char *hemi) {
+    char *end;
+    uint32_t whole = strtoul(value, &end, 10);
+    uint32_t frac = 0;
+    uint32_t scale = 1000000;
+
+    if (*end == '.') {
+        for (const char *c = end + 1; *c >= '0' && *c <= '9' && scale > 1; c++) {
+            scale /= 10;
+            frac += (*c - '0') * scale;
+        }
+    }
+
+    // Minutes in 1e-6 units, then to micro-degrees
+    uint64_t minutes = (uint64_t)(whole % 100) * 1000000 + frac;
+    int32_t udeg = (whole / 100) * 1000000 + (int32_t)(minutes / 60);
+
+    return (hemi[0] == 'S' || hemi[0] == 'W') ? -udeg : udeg;
+}
+
+// hhmmss.ss to ms of the day
+int32_t nmea_time_ms(const char *value) {
+    char *end;
+    uint32_t hms = strtoul(value, &end, 10);
+    uint32_t ms = (*end == '.') ? (uint32_t)(strtod(end, NULL) * 1000) : 0;
+
+    return ((hms / 10000) * 3600 + (hms / 100 % 100) * 60 + hms % 100) * 1000 + ms;
+}
+
+// Parse an RMC or GGA sentence, false if it carries no valid fix
+bool nmea_parse(char *line, int32_t *time_ms, int32_t *lat, int32_t *lon) {
+    char *field[8];
+    int count = 0;
+
+    if (!nmea_checksum_ok(line) || strlen(line) < 6) {
+        return false;
+    }
+    for (char *p = line; p && count < ARRAY_SIZE(field); count++) {
+        field[count] = p;
+        p = strchr(p, ',');
+        if (p) {
+            *p++ = '\0';
+        }
+    }
+
+    const char *type = field[0] + 3;
+    int pos;
+
+    if (strcmp(type, "RMC") == 0 && count >= 7 && field[2][0] == 'A') {
+        pos = 3;
+    } else if (strcmp(type, "GGA") == 0 && count >= 7 && field[6][0] > '0') {
+        pos = 2;
+    } else {
+        return false;
+    }
+    if (!field[pos][0] || !field[pos + 2][0]) {
+        return false;
+    }
+
+    *time_ms = nmea_time_ms(field[1]);
+    *lat = nmea_coord(field[pos], field[pos + 1]);
+    *lon = nmea_coord(field[pos + 2], field[pos + 3]);
+    return true;
+}
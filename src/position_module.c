@@ -0,0 +1,153 @@
+#include <stdlib.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/atomic.h>
+#include "position_module.h"
+
+#if POSITION_SOURCE == POSITION_GNSS
+#include <modem/nrf_modem_lib.h>
+#elif POSITION_SOURCE == POSITION_REPLAY
+#include <zephyr/fs/fs.h>
+#include "ble_settings.h"
+#include "nmea.h"
+#include "sdcard_module.h"
+#endif
+
+LOG_MODULE_REGISTER(position_module, LOG_LEVEL_INF);
+
+/*
+ * Latest fix, guarded by a sequence counter: the writer makes it odd while
+ * updating, readers copy the fix and retry if the counter was odd or moved.
+ */
+static atomic_t pos_seq = ATOMIC_INIT(0);
+static struct gnss_s pos_shared = {POSITION_FIXED_LAT, POSITION_FIXED_LON};
+
+void position_publish(uint32_t latitude, uint32_t longitude) {
+    bool isr = k_is_in_isr();
+
+    // A reader thread must not preempt a half written fix, it would spin on it
+    if (!isr) {
+        k_sched_lock();
+    }
+    atomic_inc(&pos_seq);
+    pos_shared.latitude = latitude;
+    pos_shared.longitude = longitude;
+    atomic_inc(&pos_seq);
+    if (!isr) {
+        k_sched_unlock();
+    }
+}
+
+void position_get(struct gnss_s *pos) {
+    atomic_val_t seq;
+
+    do {
+        seq = atomic_get(&pos_seq);
+        pos->latitude = pos_shared.latitude;
+        pos->longitude = pos_shared.longitude;
+    } while ((seq & 1) || seq != atomic_get(&pos_seq));
+}
+
+#if POSITION_SOURCE == POSITION_REPLAY
+#define NMEA_LINE_MAX 96
+
+/*
+ * Replay backend: streams POSITION_REPLAY_FILE and publishes each fix at the
+ * recorded spacing divided by POSITION_REPLAY_SPEED, starting over at the end.
+ */
+static void position_replay_thread(void) {
+    struct fs_file_t file;
+    char chunk[64];
+    char line[NMEA_LINE_MAX];
+    size_t line_len = 0;
+    int32_t prev_ms = -1;
+    uint32_t fixes = 0;
+
+    // The logger mounts the card on the receiver, an advertiser mounts it here
+    #if ROLE
+        if (sdcard_wait_ready(K_SECONDS(30)) != 0) {
+            LOG_ERR("Replay: storage not ready");
+            return;
+        }
+    #else
+        sdcard_init();
+    #endif
+
+    fs_file_t_init(&file);
+    if (fs_open(&file, POSITION_REPLAY_FILE, FS_O_READ) != 0) {
+        LOG_ERR("Replay: cannot open %s", POSITION_REPLAY_FILE);
+        return;
+    }
+    LOG_INF("Replaying %s at %ux", POSITION_REPLAY_FILE, POSITION_REPLAY_SPEED);
+
+    while (true) {
+        ssize_t n = fs_read(&file, chunk, sizeof(chunk));
+
+        if (n <= 0) {
+            if (fixes == 0) {
+                LOG_ERR("Replay: no valid fix in %s", POSITION_REPLAY_FILE);
+                break;
+            }
+            fs_seek(&file, 0, FS_SEEK_SET);
+            line_len = 0;
+            prev_ms = -1;
+            continue;
+        }
+
+        for (ssize_t i = 0; i < n; i++) {
+            if (chunk[i] != '\n') {
+                if (chunk[i] != '\r' && line_len < sizeof(line) - 1) {
+                    line[line_len++] = chunk[i];
+                }
+                continue;
+            }
+            line[line_len] = '\0';
+            line_len = 0;
+
+            int32_t time_ms, lat, lon;
+
+            if (!nmea_parse(line, &time_ms, &lat, &lon) || time_ms == prev_ms) {
+                continue;
+            }
+
+            // Keep the recorded spacing, 1 s if the gap is missing or implausible
+            int32_t gap = time_ms - prev_ms;
+
+            if (prev_ms < 0 || gap <= 0 || gap > 10000) {
+                gap = 1000;
+            }
+            prev_ms = time_ms;
+            k_sleep(K_MSEC(gap / POSITION_REPLAY_SPEED));
+
+            position_publish((uint32_t)lat, (uint32_t)lon);
+            fixes++;
+        }
+    }
+
+    fs_close(&file);
+}
+
+K_THREAD_DEFINE(position_replay_tid, 2048, position_replay_thread, NULL, NULL, NULL, 8, 0, SYS_FOREVER_MS);
+#endif
+
+int position_init(void) {
+#if POSITION_SOURCE == POSITION_GNSS
+    int err = nrf_modem_lib_init();
+    if (err) {
+        LOG_ERR("Failed to initialize modem, error: %d", err);
+        return err;
+    }
+
+    err = setup_gnss(NULL);
+    if (err) {
+        LOG_ERR("GNSS setup failed (err %d)", err);
+    }
+    return err;
+#elif POSITION_SOURCE == POSITION_REPLAY
+    k_thread_start(position_replay_tid);
+    return 0;
+#else
+    return 0;
+#endif
+}
@@ -0,0 +1,134 @@
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/random/random.h>
+#include <zephyr/sys/byteorder.h>
+#include "ble_settings.h"
+#include "beacon_module.h"
+#include "relay_module.h"
+#include "metrics_module.h"
+
+LOG_MODULE_REGISTER(relay_module, LOG_LEVEL_INF);
+
+/*
+ * Store-and-forward flooding: the first time a message is heard it is held
+ * for a random delay, then re-advertised on the relay set with one hop more
+ * and one TTL less. Every other transmitter heard with the same message
+ * while waiting counts towards RELAY_SUPPRESS_COUNT, which cancels our copy.
+ */
+struct relay_entry {
+    bool used;
+    uint8_t origin;
+    uint8_t msg_type;     // urgent and periodic messages number independently
+    uint16_t seq;
+    uint32_t heard;       // transmitters heard with this message, one bit per address hash
+};
+
+static struct relay_entry relay_cache[RELAY_CACHE_LEN];
+static int relay_cache_next;
+static struct k_spinlock relay_lock;
+
+static struct relay_entry *relay_pending_entry; // message waiting for its rebroadcast
+static struct adv_payload relay_pending_msg;
+static struct k_work_delayable relay_work;
+
+// Copies of one burst come from the same address, only distinct transmitters count
+static uint32_t relay_addr_bit(const bt_addr_le_t *addr) {
+    const uint8_t *a = addr->a.val;
+
+    return BIT(((sys_get_le32(a) ^ sys_get_le16(a + 4)) * 2654435761U) >> 27);
+}
+
+static struct relay_entry *relay_lookup(uint8_t origin, uint8_t msg_type, uint16_t seq) {
+    for (int i = 0; i < RELAY_CACHE_LEN; i++) {
+        struct relay_entry *e = &relay_cache[i];
+
+        if (e->used && e->origin == origin && e->msg_type == msg_type && e->seq == seq) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+static void relay_work_handler(struct k_work *work) {
+    struct adv_payload msg;
+    bool suppressed;
+
+    k_spinlock_key_t key = k_spin_lock(&relay_lock);
+
+    if (!relay_pending_entry) {
+        k_spin_unlock(&relay_lock, key);
+        return;
+    }
+    suppressed = __builtin_popcount(relay_pending_entry->heard) > RELAY_SUPPRESS_COUNT;
+    msg = relay_pending_msg;
+    relay_pending_entry = NULL;
+    k_spin_unlock(&relay_lock, key);
+
+    if (suppressed) {
+        metrics_inc(METRIC_RELAY_SUPPRESSED);
+        return;
+    }
+
+    uint8_t hops = (msg.hops & ADV_HOPS_MASK) + 1;
+    uint8_t ttl = (msg.hops >> ADV_TTL_SHIFT) - 1;
+
+    msg.hops = (ttl << ADV_TTL_SHIFT) | MIN(hops, ADV_HOPS_MASK);
+    if (advertising_relay(&msg, RELAY_COPIES) == 0) {
+        metrics_inc(METRIC_RELAY_SENT);
+    } else {
+        metrics_inc(METRIC_RELAY_DROPS);
+    }
+}
+
+void relay_observe(const bt_addr_le_t *addr, const struct adv_payload *msg) {
+    uint8_t origin = msg->header & ADV_HDR_NODE_MASK;
+    uint8_t msg_type = msg->msg_type & ADV_MSG_TYPE_MASK;
+    bool schedule = false;
+
+    k_spinlock_key_t key = k_spin_lock(&relay_lock);
+    struct relay_entry *e = relay_lookup(origin, msg_type, msg->number_press);
+
+    if (e) {
+        e->heard |= relay_addr_bit(addr);
+        k_spin_unlock(&relay_lock, key);
+        return;
+    }
+
+    e = &relay_cache[relay_cache_next];
+    relay_cache_next = (relay_cache_next + 1) % RELAY_CACHE_LEN;
+    if (e == relay_pending_entry) {
+        relay_pending_entry = NULL; // evicted before its turn
+    }
+    *e = (struct relay_entry){
+        .used = true,
+        .origin = origin,
+        .msg_type = msg_type,
+        .seq = msg->number_press,
+        .heard = relay_addr_bit(addr),
+    };
+
+    if ((msg->hops >> ADV_TTL_SHIFT) > 0) {
+        if (relay_pending_entry) {
+            metrics_inc(METRIC_RELAY_DROPS); // one rebroadcast at a time
+        } else {
+            relay_pending_entry = e;
+            relay_pending_msg = *msg;
+            schedule = true;
+        }
+    }
+
+    k_spin_unlock(&relay_lock, key);
+
+    if (schedule) {
+        uint32_t delay = RELAY_DELAY_MIN_MS +
+                         sys_rand32_get() % (RELAY_DELAY_MAX_MS - RELAY_DELAY_MIN_MS + 1);
+
+        k_work_reschedule(&relay_work, K_MSEC(delay));
+    }
+}
+
+int relay_init(void) {
+    k_work_init_delayable(&relay_work, relay_work_handler);
+    LOG_INF("Relay on: TTL %u, suppression after %u copies", RELAY_TTL, RELAY_SUPPRESS_COUNT);
+    return 0;
+}
@@ -1,37 +1,34 @@
 #include <zephyr/logging/log.h>
 #include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/byteorder.h>
+#include <math.h>
 // #include <stdlib.h>
 #include "scan_module.h"
 #include "gnss_module.h"
 #include "ble_settings.h"
 #include "sdcard_module.h"
+#include "aoi_module.h"
+#include "beacon_module.h"
+#include "clock_sync_module.h"
+#include "metrics_module.h"
+#include "relay_module.h"
+#include "sched_module.h"
+#include "payload_module.h"
+#include "trace_module.h"
 
 LOG_MODULE_REGISTER(scan_module, LOG_LEVEL_INF);  // Separate logging module for Bluetooth
 
-struct packet_data {
-    uint16_t number_press;
-    uint16_t tx_delay;
-    uint32_t latitude;
-    uint32_t longitude;
-    uint8_t tx_hour;
-    uint8_t tx_minute;
-    uint8_t tx_second;
-    uint16_t tx_ms;
-    uint8_t rx_hour;
-    uint8_t rx_minute;
-    uint8_t rx_second;
-    uint16_t rx_ms;
-    int8_t rssi;
-    uint32_t aoi;
-};
-
 // Marker packet 
-static struct packet_data null_pkt = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
-static struct packet_data error_pkt = {1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1};
+static struct packet_data null_pkt = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+static struct packet_data error_pkt = {1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1};
+
+// Deep enough to hold the records received while the SD card is still mounting
+#define PACKET_QUEUE_LEN 64
 
 #if !defined(CONFIG_BOARD_NRF9160DK_NRF52840)
     // #if ROLE
-        K_MSGQ_DEFINE(packet_msgq, sizeof(struct packet_data), 10, 4);
+        K_MSGQ_DEFINE(packet_msgq, sizeof(struct packet_data), PACKET_QUEUE_LEN, 4);
     // #endif
 #endif
 
@@ -39,56 +36,366 @@ static struct packet_data error_pkt = {1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1}
 
 static bool packet_received = false;
 
-static bool sd_record = false;
+#if !defined(CONFIG_BOARD_NRF9160DK_NRF52840) && ROLE
+#define SCAN_RECORDS_TO_SD 1
+#else
+#define SCAN_RECORDS_TO_SD 0
+#endif
 
-static struct rtc_time_s rtc_time = {0,0,0,0,0};
+#if SCAN_RECORDS_TO_SD
+// Hand a record to the SD card thread
+static void queue_record(const struct packet_data *pkt) {
+    if (k_msgq_put(&packet_msgq, pkt, K_NO_WAIT) != 0) {
+        metrics_inc(METRIC_QUEUE_DROPS);
+        // Expected while the card is not ready, the drops are in the queue_drops stat
+        if (sdcard_is_ready()) {
+            LOG_ERR("Message queue full. Dropping packet.");
+        }
+        return;
+    }
 
-// Add a variable to store the timestamp of the last packet
-static uint32_t last_packet_time = 0;
+    TRACE(TRACE_QUEUE_PUT, pkt->number_press);
+
+    uint32_t depth = k_msgq_num_used_get(&packet_msgq);
+
+    metrics_set(METRIC_QUEUE_DEPTH, depth);
+    metrics_max(METRIC_QUEUE_PEAK, depth);
+}
+
+#if !SCAN_LOG_EVERY_COPY
+/*
+ * Duplicate suppression: every message goes out PACKET_COPIES times. The
+ * first arrival from a peer is held for DEDUP_HOLD_MS, later copies with the
+ * same sequence number only bump its copy count, then the first arrival is
+ * forwarded annotated with the count and the first-to-last copy spread.
+ * The hold covers the worst-case burst: PACKET_COPIES - 1 gaps of one
+ * advertising interval plus the 10 ms maximum advDelay, and a margin for
+ * the scan window switch and the scheduling of the flush work.
+ */
+#define DEDUP_PEERS 4
+#define DEDUP_HOLD_MARGIN_MS 30
+#define DEDUP_HOLD_MS ((PACKET_COPIES - 1) * (ADV_INTERVAL * 5 / 8 + 10) + DEDUP_HOLD_MARGIN_MS)
+
+struct dedup_peer {
+    bt_addr_le_t addr;
+    bool used;
+    bool holding;       // pkt is waiting for further copies
+    uint16_t seq;       // Held or last forwarded message
+    uint32_t first_rx;
+    uint32_t last_rx;
+    struct packet_data pkt;
+};
+
+static struct dedup_peer dedup_peers[DEDUP_PEERS];
+static struct k_spinlock dedup_lock;
+
+static void dedup_flush_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(dedup_flush_work, dedup_flush_handler);
+
+// Finish a held record, call with dedup_lock held and queue the copy after unlocking
+static void dedup_release(struct dedup_peer *peer, struct packet_data *out) {
+    *out = peer->pkt;
+    out->copy_spread = MIN(peer->last_rx - peer->first_rx, UINT16_MAX);
+    peer->holding = false;
+}
+
+static struct dedup_peer *dedup_find(const bt_addr_le_t *addr) {
+    for (int i = 0; i < DEDUP_PEERS; i++) {
+        if (dedup_peers[i].used && bt_addr_le_eq(&dedup_peers[i].addr, addr)) {
+            return &dedup_peers[i];
+        }
+    }
+    return NULL;
+}
+
+static bool dedup_is_copy(const bt_addr_le_t *addr, uint16_t seq, uint32_t uptime) {
+    bool copy = false;
+    k_spinlock_key_t key = k_spin_lock(&dedup_lock);
+    struct dedup_peer *peer = dedup_find(addr);
+
+    if (peer && peer->seq == seq) {
+        copy = true;
+        if (peer->holding) {
+            peer->last_rx = uptime;
+            if (peer->pkt.copies < UINT8_MAX) {
+                peer->pkt.copies++;
+            }
+        }
+    }
+
+    k_spin_unlock(&dedup_lock, key);
+    if (copy) {
+        metrics_inc(METRIC_SCAN_DUPLICATES);
+    }
+    return copy;
+}
+
+static void dedup_hold(const bt_addr_le_t *addr, uint16_t seq, const struct packet_data *pkt,
+                       uint32_t uptime) {
+    struct packet_data released;
+    bool release = false;
+    k_spinlock_key_t key = k_spin_lock(&dedup_lock);
+    struct dedup_peer *peer = dedup_find(addr);
+
+    if (!peer) {
+        // Take a free slot or evict the peer heard least recently
+        peer = &dedup_peers[0];
+        for (int i = 0; i < DEDUP_PEERS; i++) {
+            if (!dedup_peers[i].used) {
+                peer = &dedup_peers[i];
+                break;
+            }
+            if ((int32_t)(dedup_peers[i].last_rx - peer->last_rx) < 0) {
+                peer = &dedup_peers[i];
+            }
+        }
+        peer->used = true;
+        bt_addr_le_copy(&peer->addr, addr);
+    } 
+
+    // A new sequence number closes the previous message early
+    if (peer->holding) {
+        dedup_release(peer, &released);
+        release = true;
+    }
+
+    peer->holding = true;
+    peer->seq = seq;
+    peer->first_rx = uptime;
+    peer->last_rx = uptime;
+    peer->pkt = *pkt;
+
+    k_spin_unlock(&dedup_lock, key);
+
+    if (release) {
+        queue_record(&released);
+    }
+    k_work_schedule(&dedup_flush_work, K_MSEC(DEDUP_HOLD_MS));
+}
+
+static void dedup_flush_handler(struct k_work *work) {
+    uint32_t now = k_uptime_get_32();
+    int32_t next_due = -1;
+
+    for (int i = 0; i < DEDUP_PEERS; i++) {
+        struct packet_data released;
+        bool release = false;
+        k_spinlock_key_t key = k_spin_lock(&dedup_lock);
+        struct dedup_peer *peer = &dedup_peers[i];
+
+        if (peer->holding) {
+            int32_t remaining = DEDUP_HOLD_MS - (int32_t)(now - peer->first_rx);
+
+            if (remaining <= 0) {
+                dedup_release(peer, &released);
+                release = true;
+            } else if (next_due < 0 || remaining < next_due) {
+                next_due = remaining;
+            }
+        }
+        k_spin_unlock(&dedup_lock, key);
+
+        if (release) {
+            queue_record(&released);
+        }
+    }
+
+    if (next_due >= 0) {
+        k_work_schedule(&dedup_flush_work, K_MSEC(next_due));
+    }
+}
+
+// Release every held message now, so that it lands before a marker row that follows
+void dedup_flush_all(void) {
+    for (int i = 0; i < DEDUP_PEERS; i++) {
+        struct packet_data released;
+        bool release = false;
+        k_spinlock_key_t key = k_spin_lock(&dedup_lock);
+
+        if (dedup_peers[i].holding) {
+            dedup_release(&dedup_peers[i], &released);
+            release = true;
+        }
+        k_spin_unlock(&dedup_lock, key);
+
+        if (release) {
+            queue_record(&released);
+        }
+    }
+}
+#endif // !SCAN_LOG_EVERY_COPY
+#endif
 
-void reset_last_packet_time(void) {
-    last_packet_time = k_uptime_get();
+#if !SCAN_RECORDS_TO_SD || SCAN_LOG_EVERY_COPY
+void dedup_flush_all(void) {
 }
+#endif
+
+static bool sd_record = false;
+
+static struct rtc_time_s rtc_time = {0,0,0,0,0};
 
+// Add a variable to store the timestamp of the last packet
 void switch_recording(bool state) {
     sd_record = state;
+    if (!state) {
+        dedup_flush_all();
+    }
 }
 
-static void parse_advertisement_data(const uint8_t *data, int len, char *name_buf, size_t name_buf_size, const uint8_t **manufacturer_data, int *manufacturer_data_len) {
-     // Ensure the output pointers are initialized
-     if (name_buf_size > 0) {
-        name_buf[0] = '\0';  // Initialize to empty string
-    }
+// Returns false if an AD structure runs past the end of the data, i.e. the report was cut short
+static bool parse_advertisement_data(const uint8_t *data, int len, const uint8_t **manufacturer_data, int *manufacturer_data_len) {
+    // Ensure the output pointers are initialized
     *manufacturer_data = NULL;
     *manufacturer_data_len = 0;
     
     while (len > 0) {
         uint8_t field_len = data[0];
-        if (field_len == 0 || field_len > len - 1) {
+        if (field_len == 0) {
             break;
         }
+        if (field_len > len - 1) {
+            return false;
+        }
         
         uint8_t field_type = data[1];
         const uint8_t *field_data = data + 2;
         int field_data_len = field_len - 1;
 
-        if (field_type == BT_DATA_NAME_COMPLETE && name_buf_size > 0 && name_buf[0] == '\0') {
-            size_t copy_len = field_data_len < name_buf_size - 1 ? field_data_len : name_buf_size - 1;
-            memcpy(name_buf, field_data, copy_len);
-            name_buf[copy_len] = '\0';
-        }
-
-        if (field_type == BT_DATA_MANUFACTURER_DATA && *manufacturer_data == NULL) {  // Manufacturer Specific Data
+        if (field_type == BT_DATA_MANUFACTURER_DATA) {  // Manufacturer Specific Data
             *manufacturer_data = field_data;
             *manufacturer_data_len = field_data_len;
+            return true;
         }
 
         // Move to the next field
         data += field_len + 1;
         len -= field_len + 1;
     }
+    return true;
+}
+
+// Last absolute position received per node id, used to expand the deltas
+struct pos_anchor {
+    bool valid;
+    uint8_t epoch;
+    uint32_t latitude;
+    uint32_t longitude;
+};
+
+static struct pos_anchor pos_anchors[ADV_HDR_NODE_MASK + 1];
+
+// Resolve the position of a payload to absolute values, 0/0 if its anchor was missed
+static void decode_position(const struct adv_payload *data, uint32_t *latitude, uint32_t *longitude) {
+    struct pos_anchor *anchor = &pos_anchors[data->header & ADV_HDR_NODE_MASK];
+    uint8_t epoch = (data->header >> ADV_HDR_EPOCH_SHIFT) & ADV_HDR_EPOCH_MASK;
+
+    if ((data->msg_type & ADV_MSG_TYPE_MASK) == ADV_MSG_URGENT) {
+        // Always absolute and outside the epochs of the periodic stream
+        *latitude = data->latitude;
+        *longitude = data->longitude;
+    } else if (data->header & ADV_HDR_ANCHOR) {
+        anchor->latitude = data->latitude;
+        anchor->longitude = data->longitude;
+        anchor->epoch = epoch;
+        anchor->valid = true;
+        *latitude = anchor->latitude;
+        *longitude = anchor->longitude;
+    } else if (anchor->valid && anchor->epoch == epoch) {
+        *latitude = anchor->latitude + data->latitude;
+        *longitude = anchor->longitude + data->longitude;
+    } else {
+        *latitude = 0;
+        *longitude = 0;
+    }
+}
+
+#if SCAN_RECORDS_TO_SD && PIGGYBACK_K
+/*
+ * Sequence numbers seen per origin: bit i of mask is top - i. Everything
+ * before the first message counts as seen, so the history of a sender that
+ * was running before we started is not logged as recovered.
+ */
+struct seq_window {
+    bool valid;
+    uint16_t top;
+    uint32_t mask;
+};
+
+static struct seq_window seq_windows[ADV_HDR_NODE_MASK + 1];
+
+// Move the window to the carrier seq, false for another copy of the current message
+static bool seq_window_advance(uint8_t origin, uint16_t seq) {
+    struct seq_window *w = &seq_windows[origin];
+    int16_t step = seq - w->top;
+
+    if (w->valid && step == 0) {
+        return false;
+    }
+    // Direct messages arrive in order, a step back is a restart of the sender
+    if (!w->valid || step < 0) {
+        *w = (struct seq_window){.valid = true, .top = seq, .mask = UINT32_MAX};
+        return true;
+    }
+    w->mask = step >= 32 ? 1 : (w->mask << step) | 1;
+    w->top = seq;
+    return true;
 }
 
+// Mark a seq behind the carrier as seen, returns true if it was not seen before
+static bool seq_window_mark(uint8_t origin, uint16_t seq) {
+    struct seq_window *w = &seq_windows[origin];
+    uint16_t back = w->top - seq;
+
+    if (back >= 32) {
+        return false;
+    }
+
+    bool seen = w->mask & BIT(back);
+
+    w->mask |= BIT(back);
+    return !seen;
+}
+
+// Record the messages before `pkt` that only its piggybacked history brought in
+static void piggyback_recover(const struct adv_payload *data, const struct packet_data *pkt,
+                              const uint8_t *history_data, size_t history_len) {
+    struct adv_history history[PIGGYBACK_K];
+    uint8_t origin = data->header & ADV_HDR_NODE_MASK;
+    uint32_t tx_ms = aoi_packed_to_ms(data->timestamp);
+    uint8_t count = adv_history_unpack(history, PIGGYBACK_K, history_data, history_len);
+
+    for (uint8_t i = 0; i < count; i++) {
+        uint16_t seq = data->number_press - (i + 1);
+
+        if (seq == 0 || !seq_window_mark(origin, seq)) {
+            continue;
+        }
+
+        struct packet_data rec = *pkt;
+        uint32_t ms = (tx_ms + AOI_DAY_MS - history[i].dt_ms) % AOI_DAY_MS;
+
+        rec.number_press = seq;
+        rec.tx_delay = history[i].tx_delay;
+        rec.tx_hour = ms / 3600000U;
+        rec.tx_minute = ms / 60000U % 60;
+        rec.tx_second = ms / 1000U % 60;
+        rec.tx_ms = ms % 1000U;
+        // Offsets to the absolute position of the carrier, unknown if its anchor was missed
+        if (pkt->latitude != 0 || pkt->longitude != 0) {
+            rec.latitude = pkt->latitude + history[i].dlat;
+            rec.longitude = pkt->longitude + history[i].dlon;
+        }
+        rec.aoi = 0;
+        rec.copies = 0;
+        rec.copy_spread = 0;
+        rec.recovered = 1;
+        queue_record(&rec);
+        metrics_inc(METRIC_PIGGYBACK_RECOVERED);
+    }
+}
+#endif
+
 bool is_packet_received(void) {
     return packet_received;
 }
@@ -97,10 +404,10 @@ void reset_packet_received(void) {
     packet_received = false;
 }
 
-// Function to get current time as a single integer
-static uint32_t get_current_time_packed(void) {
+// Function to get the time at a given uptime as a single integer
+static uint32_t get_time_packed_at(uint32_t uptime) {
     // Calculate runtime milliseconds since last update
-    uint32_t runtime_ms = k_uptime_get() - rtc_time.last_runtime;
+    uint32_t runtime_ms = clock_sync_ms(uptime) - rtc_time.last_runtime;
     uint32_t total_ms = rtc_time.ms + runtime_ms;
 
     // Calculate the components of the current time
@@ -129,6 +436,129 @@ static uint32_t get_current_time_packed(void) {
     return packed_time;
 }
 
+#if !defined(CONFIG_BOARD_NRF9160DK_NRF52840) && ROLE
+// Function to get current time as a single integer
+static uint32_t get_current_time_packed(void) {
+    return get_time_packed_at(k_uptime_get_32());
+}
+#endif
+
+
+static struct bt_le_scan_cb scan_callbacks;
+static bool scan_callbacks_registered = false;
+
+/*
+ * Reception per sender channel map. The controller does not say which
+ * primary channel a report came in on, so senders put their channel map in
+ * the message type and the counters are kept per map: messages expected from
+ * the sequence numbers, messages received and copies received.
+ */
+struct chan_stats {
+    uint32_t expected;
+    uint32_t received;
+    uint32_t copies;
+};
+
+static struct chan_stats chan_stats[ADV_MSG_CHAN_MASK + 1];
+static uint16_t chan_last_seq[ADV_HDR_NODE_MASK + 1];
+static bool chan_seq_valid[ADV_HDR_NODE_MASK + 1];
+static struct k_spinlock chan_lock;
+
+static void chan_stats_update(uint8_t origin, uint8_t channels, uint16_t seq) {
+    k_spinlock_key_t key = k_spin_lock(&chan_lock);
+    struct chan_stats *c = &chan_stats[channels];
+    uint16_t step = seq - chan_last_seq[origin];
+
+    c->copies++;
+    if (!chan_seq_valid[origin] || step != 0) {
+        // Skipped sequence numbers were lost, a step back is a restart of the sender
+        c->expected += (chan_seq_valid[origin] && step < 0x8000) ? step : 1;
+        c->received++;
+        chan_last_seq[origin] = seq;
+        chan_seq_valid[origin] = true;
+    }
+
+    k_spin_unlock(&chan_lock, key);
+}
+
+void scan_channel_stats_restart(void) {
+    struct chan_stats stats[ADV_MSG_CHAN_MASK + 1];
+    k_spinlock_key_t key = k_spin_lock(&chan_lock);
+
+    memcpy(stats, chan_stats, sizeof(stats));
+    memset(chan_stats, 0, sizeof(chan_stats));
+    memset(chan_seq_valid, 0, sizeof(chan_seq_valid));
+    k_spin_unlock(&chan_lock, key);
+
+    for (int i = 0; i <= ADV_MSG_CHAN_MASK; i++) {
+        if (stats[i].received == 0) {
+            continue;
+        }
+        LOG_INF("Channels %s: %u of %u messages (%u per mille), %u copies per 10 messages",
+                adv_channels_name(i), stats[i].received, stats[i].expected,
+                stats[i].received * 1000 / stats[i].expected,
+                stats[i].copies * 10 / stats[i].received);
+    }
+}
+
+/*
+ * Census of the reports that are not ours (no company id, cut short or
+ * malformed) while a test records, to tell a busy channel from a bad
+ * link. Counting costs an increment, a bit set and a bin increment per
+ * report. Distinct addresses come from linear counting: each address sets
+ * one bit of a hashed bitmap, n = m * ln(m / empty bits).
+ */
+BUILD_ASSERT((CENSUS_BITMAP_BITS & (CENSUS_BITMAP_BITS - 1)) == 0, "CENSUS_BITMAP_BITS must be a power of two");
+BUILD_ASSERT(METRIC_CENSUS_RSSI_GE60 - METRIC_CENSUS_RSSI_LT90 + 1 == CENSUS_RSSI_BINS);
+
+static atomic_t census_reports;
+static ATOMIC_DEFINE(census_bitmap, CENSUS_BITMAP_BITS);
+static atomic_t census_rssi[CENSUS_RSSI_BINS];
+
+static void census_count(const bt_addr_le_t *addr, int8_t rssi) {
+    const uint8_t *a = addr->a.val;
+    uint32_t hash = (sys_get_le32(a) ^ sys_get_le16(a + 4)) * 2654435761U;
+    int bin = CLAMP((rssi + 100) / 10, 0, CENSUS_RSSI_BINS - 1);
+
+    atomic_inc(&census_reports);
+    atomic_set_bit(census_bitmap, hash >> (32 - __builtin_ctz(CENSUS_BITMAP_BITS)));
+    atomic_inc(&census_rssi[bin]);
+}
+
+void scan_census_restart(void) {
+    uint32_t reports = atomic_clear(&census_reports);
+    uint32_t used = 0;
+    uint32_t devices;
+
+    for (int i = 0; i < ATOMIC_BITMAP_SIZE(CENSUS_BITMAP_BITS); i++) {
+        used += __builtin_popcount(atomic_clear(&census_bitmap[i]));
+    }
+    for (int i = 0; i < CENSUS_RSSI_BINS; i++) {
+        metrics_set(METRIC_CENSUS_RSSI_LT90 + i, atomic_clear(&census_rssi[i]));
+    }
+
+    // A full bitmap only gives a lower bound, taken as if one bit were still empty
+    devices = CENSUS_BITMAP_BITS * log((double)CENSUS_BITMAP_BITS /
+                                       MAX(CENSUS_BITMAP_BITS - used, 1)) + 0.5;
+
+    metrics_set(METRIC_CENSUS_REPORTS, reports);
+    metrics_set(METRIC_CENSUS_DEVICES, devices);
+    LOG_INF("Background: %u reports from about %u devices, RSSI %u/%u/%u/%u/%u (< -90 .. >= -60 dBm)",
+            reports, devices, metrics_get(METRIC_CENSUS_RSSI_LT90), metrics_get(METRIC_CENSUS_RSSI_LT80),
+            metrics_get(METRIC_CENSUS_RSSI_LT70), metrics_get(METRIC_CENSUS_RSSI_LT60),
+            metrics_get(METRIC_CENSUS_RSSI_GE60));
+}
+
+// Primary PHYs scanned, taken into account at the next scan start
+static uint8_t scan_phys = SCAN_PHYS;
+
+int scan_set_phy(uint8_t phys) {
+    if (phys == 0 || (phys & ~(BT_GAP_LE_PHY_1M | BT_GAP_LE_PHY_CODED))) {
+        return -ENOTSUP;
+    }
+    scan_phys = phys;
+    return 0;
+}
 
 // Start Bluetooth scanning
 int ble_start_scanning(void) {
@@ -139,7 +569,20 @@ int ble_start_scanning(void) {
         .window = SCAN_WINDOW,
     };
 
-    int err = bt_le_scan_start(&scan_param, scan_cb);
+    // 2M is never a primary PHY, the controller follows AUX_PTR to it on its own
+    if (scan_phys & BT_GAP_LE_PHY_CODED) {
+        scan_param.options |= BT_LE_SCAN_OPT_CODED;
+    }
+    if (!(scan_phys & BT_GAP_LE_PHY_1M)) {
+        scan_param.options |= BT_LE_SCAN_OPT_NO_1M;
+    }
+
+    if (!scan_callbacks_registered) {
+        bt_le_scan_cb_register(&scan_callbacks);
+        scan_callbacks_registered = true;
+    }
+
+    int err = bt_le_scan_start(&scan_param, NULL);
     if (err) {
         LOG_ERR("Starting scanning failed (err %d)", err);
         return err;
@@ -149,78 +592,136 @@ int ble_start_scanning(void) {
     return 0;
 }
 
-// Bluetooth scan callback
-void scan_cb(const bt_addr_le_t *addr, int8_t rssi, uint8_t type, struct net_buf_simple *ad) {
-    
-    char addr_str[BT_ADDR_LE_STR_LEN];
-    bt_addr_le_to_str(addr, addr_str, sizeof(addr_str));
+// With relaying every other project node's messages are of interest, otherwise only the test peer's
+#if RELAY_MODE
+    #define ORIGIN_ACCEPTED(id) ((id) != NODE_ID && (id) >= 1 && (id) <= NODE_ID_MAX)
+#else
+    #define ORIGIN_ACCEPTED(id) ((id) == PEER_NODE_ID)
+#endif
+
+// Metadata of one report from bt_le_scan_recv_info, carried into the record
+struct scan_meta {
+    int8_t rssi;
+    int8_t tx_power;        // BT_GAP_TX_POWER_INVALID if not advertised
+    uint8_t sid;            // BT_GAP_SID_INVALID for legacy PDUs
+    uint8_t adv_type;
+    uint16_t adv_props;     // BT_GAP_ADV_PROP_*
+    uint8_t primary_phy;
+    uint8_t secondary_phy;  // 0 for legacy PDUs
+    bool truncated;         // AD data cut short before reaching the parser
+};
+
+static void scan_meta_from_info(struct scan_meta *meta, const struct bt_le_scan_recv_info *info) {
+    *meta = (struct scan_meta){
+        .rssi = info->rssi,
+        .tx_power = info->tx_power,
+        .sid = info->sid,
+        .adv_type = info->adv_type,
+        .adv_props = info->adv_props,
+        .primary_phy = info->primary_phy,
+        .secondary_phy = info->secondary_phy,
+    };
+}
+
+// Decode one advertising report received at `uptime` (rx_us in us) and hand it to the SD card thread
+static void process_report(const bt_addr_le_t *addr, const struct scan_meta *meta,
+                           const uint8_t *ad_data, uint16_t ad_len, uint32_t uptime,
+                           int64_t rx_us) {
+    // char addr_str[BT_ADDR_LE_STR_LEN];
+    // bt_addr_le_to_str(addr, addr_str, sizeof(addr_str));
     struct packet_data pkt;
 
-    // Get the current time as a string
-    uint32_t current_time = get_current_time_packed();
-    uint32_t uptime = k_uptime_get();
+    // Get the reception time as a string
+    uint32_t current_time = get_time_packed_at(uptime);
 
-    char name_buf[32];  // Adjust size as needed
-    const uint16_t *manufacturer_data = NULL;
+    const uint8_t *manufacturer_data = NULL;
     int manufacturer_data_len = 0;
 
-    parse_advertisement_data(ad->data, ad->len, name_buf, sizeof(name_buf), &manufacturer_data, &manufacturer_data_len);
+    bool truncated = meta->truncated ||
+                     !parse_advertisement_data(ad_data, ad_len, &manufacturer_data, &manufacturer_data_len);
 
-    // LOG_INF("Device found: %s (RSSI %d), type %u, AD data len %u, device name: %s\n",
-    //     addr_str, rssi, type, ad->len, name ? name : "(unknown)");
+    if (truncated) {
+        metrics_inc(METRIC_SCAN_TRUNCATED);
+    }
 
-    // Choose the name string to compare
-    const char *name = name_buf[0] ? name_buf : NULL;
+    // LOG_INF("Device found: %s (RSSI %d), type %u, AD data len %u\n",
+    //     addr_str, meta->rssi, meta->adv_type, ad_len);
 
-    #ifdef CONFIG_BOARD_NRF9160DK_NRF52840
-        if (name && strcmp(name, "B2B1") == 0) {
-    #else
-        #if ROLE
-            if (name && strcmp(name, "B2B2") == 0) {
-        #else
-            if (name && strcmp(name, "B2B1") == 0) {
-        #endif
-    #endif
+    // Our messages carry our company identifier, peers are told apart by the node id in the header
+    bool ours = manufacturer_data && adv_payload_is_ours(manufacturer_data, manufacturer_data_len);
+
+    // Everything that is not ours loads the channel, whatever its node id byte says
+    if (!ours && sd_record) {
+        census_count(addr, meta->rssi);
+    }
+
+    if (ours && ORIGIN_ACCEPTED(adv_payload_origin(manufacturer_data))) {
         // Mark that a packet was received
         packet_received = true;
+        metrics_inc(METRIC_SCAN_ACCEPTED);
+
+        struct adv_payload data;
+        int unpack_err = adv_payload_unpack(&data, manufacturer_data, manufacturer_data_len);
+
+        // Clock sync runs between the tests too, relayed copies carry extra latency
+        #if CLOCK_SYNC_BLE && !CLOCK_SYNC_REFERENCE
+            if (unpack_err == 0 && (data.msg_type & ADV_MSG_SYNC) && (data.hops & ADV_HOPS_MASK) == 0) {
+                clock_sync_observe(data.sync_us, rx_us);
+            }
+        #endif
+
+        // Forwarding does not depend on our own recording
+        #if RELAY_MODE
+            if (unpack_err == 0) {
+                relay_observe(addr, &data);
+            }
+        #endif
+
+        // Channel statistics cover direct periodic messages, markers excluded
+        if (unpack_err == 0 && (data.msg_type & ADV_MSG_TYPE_MASK) == ADV_MSG_PERIODIC &&
+            (data.hops & ADV_HOPS_MASK) == 0 && data.number_press != 0) {
+            chan_stats_update(data.header & ADV_HDR_NODE_MASK,
+                              (data.msg_type >> ADV_MSG_CHAN_SHIFT) & ADV_MSG_CHAN_MASK,
+                              data.number_press);
+        }
 
         if (sd_record == true) {
             // LOG_INF("Device found: %s (RSSI %d), type %u, AD data len %u, device name: %s\n",
-            //                 addr_str, rssi, type, ad->len,name);
-
-            if (manufacturer_data && manufacturer_data_len >= sizeof(adv_mfg_data_type)) {
-                // adv_mfg_data_type *data = (adv_mfg_data_type *)manufacturer_data;
+            //                 addr_str, meta->rssi, meta->adv_type, ad_len,name);
 
-                adv_mfg_data_type data;
-                memcpy(&data, manufacturer_data, sizeof(adv_mfg_data_type));
+            if (unpack_err == 0) {
+                uint16_t number_press = data.number_press;
+                TRACE(TRACE_SCAN_RX, number_press);
 
-                // Calculate the duration since the last packet
-                uint32_t duration_since_last_packet = 0;
-                
-                if (last_packet_time != 0) {
-                    if (uptime >= last_packet_time) {
-                        duration_since_last_packet = uptime - last_packet_time;
-                    } else {
-                        // Handle wrap-around case for a 32-bit timestamp
-                        duration_since_last_packet = (UINT32_MAX - last_packet_time) + uptime + 1;
+                #if SCAN_RECORDS_TO_SD && !SCAN_LOG_EVERY_COPY
+                    // Later copies only update the held first arrival
+                    if (dedup_is_copy(addr, number_press, uptime)) {
+                        return;
                     }
+                #endif
+
+                // Urgent messages are off the periodic schedule and have their own sequence numbers
+                bool periodic = (data.msg_type & ADV_MSG_TYPE_MASK) == ADV_MSG_PERIODIC;
+
+                // Relayed copies say nothing about the origin's transmit phase
+                if (periodic && (data.hops & ADV_HOPS_MASK) == 0) {
+                    sched_observe(data.header & ADV_HDR_NODE_MASK, uptime, number_press, data.gap_report);
                 }
-                last_packet_time = uptime; // Update the last packet time
 
-                uint16_t number_press = data.number_press[0];
-                uint16_t tx_delay = data.tx_delay[0];
-                uint32_t longitude = data.longitude[0];
-                uint32_t tx_timestamp = data.timestamp[0];
+                uint16_t tx_delay = data.tx_delay;
+                uint32_t tx_timestamp = data.timestamp;
+                uint32_t latitude;
+                uint32_t longitude;
 
-                // Raw byte values for latitude
-                uint32_t raw_latitude[4];
-                memcpy(raw_latitude, &data.latitude[0], sizeof(raw_latitude));
+                decode_position(&data, &latitude, &longitude);
 
-                // Print raw byte values of latitude
-                // LOG_INF("Raw Latitude Bytes: 0x%02X 0x%02X 0x%02X 0x%02X", raw_latitude[0], raw_latitude[1], raw_latitude[2], raw_latitude[3]);
+                // Peak age of information reached just before this message, markers carry no time
+                uint32_t aoi_age = 0;
 
-                // Convert raw bytes to uint32_t
-                uint32_t latitude = data.latitude[0];
+                if (periodic && number_press != 0) {
+                    aoi_age = aoi_update(data.header & ADV_HDR_NODE_MASK, aoi_packed_to_ms(current_time),
+                                         aoi_packed_to_ms(tx_timestamp), tx_delay);
+                }
 
                 uint8_t current_hour = (current_time >> 27) & 0x1F;
                 uint8_t current_minute = (current_time >> 21) & 0x3F;
@@ -249,48 +750,157 @@ void scan_cb(const bt_addr_le_t *addr, int8_t rssi, uint8_t type, struct net_buf
                 pkt.rx_minute = current_minute;
                 pkt.rx_second = current_second;
                 pkt.rx_ms = current_ms;
-                pkt.rssi = rssi;
-                pkt.aoi = duration_since_last_packet;
+                pkt.rssi = meta->rssi;
+                pkt.aoi = aoi_age;
+                pkt.copies = 1;
+                pkt.copy_spread = 0;
+                pkt.hops = data.hops & ADV_HOPS_MASK;
+                pkt.origin = data.header & ADV_HDR_NODE_MASK;
+                pkt.msg_type = data.msg_type & ADV_MSG_TYPE_MASK;
+                pkt.chan_map = (data.msg_type >> ADV_MSG_CHAN_SHIFT) & ADV_MSG_CHAN_MASK;
+                pkt.primary_phy = meta->primary_phy;
+                pkt.secondary_phy = meta->secondary_phy;
+                pkt.sid = meta->sid;
+                pkt.tx_power = meta->tx_power;
+                pkt.truncated = truncated;
+                pkt.recovered = 0;
+
+                // Messages this one carries in its history and that never arrived themselves
+                #if SCAN_RECORDS_TO_SD && PIGGYBACK_K
+                    if (periodic && (data.hops & ADV_HOPS_MASK) == 0 && number_press != 0 &&
+                        seq_window_advance(data.header & ADV_HDR_NODE_MASK, number_press)) {
+                        uint8_t offset = adv_payload_len(&data);
+
+                        piggyback_recover(&data, &pkt, manufacturer_data + offset,
+                                          manufacturer_data_len - offset);
+                    }
+                #endif
                 
-                #if !defined(CONFIG_BOARD_NRF9160DK_NRF52840)
-                    #if ROLE
-                        if (k_msgq_put(&packet_msgq, &pkt, K_NO_WAIT) != 0) {
-                            LOG_ERR("Message queue full. Dropping packet.");
-                        }
+                #if SCAN_RECORDS_TO_SD
+                    #if SCAN_LOG_EVERY_COPY
+                        queue_record(&pkt);
+                    #else
+                        dedup_hold(addr, number_press, &pkt, uptime);
                     #endif
                 #endif
 
             } else {
                 // LOG_INF("Invalid manufacturer-specific data length\n");
-                LOG_INF("Invalid manufacturer data length: %d (expected %d)", manufacturer_data_len, sizeof(adv_mfg_data_type));
+                LOG_DBG("Invalid manufacturer data length: %d", manufacturer_data_len);
+                census_count(addr, meta->rssi);
             }   
         }
+    }
+}
+
+#if SCAN_DEFERRED_PARSE
+/*
+ * Deferred mode: scan_recv runs in the Bluetooth RX context and only copies the
+ * raw report into a preallocated single-producer/single-consumer ring. The
+ * parser thread decodes the reports in batches at a lower priority.
+ */
+BUILD_ASSERT((RAW_REPORT_SLOTS & (RAW_REPORT_SLOTS - 1)) == 0, "RAW_REPORT_SLOTS must be a power of two");
+BUILD_ASSERT(RAW_REPORT_MAX_AD >= 3 + 2 + ADV_PAYLOAD_MAX_LEN + PIGGYBACK_K * ADV_HISTORY_ENTRY_LEN,
+             "RAW_REPORT_MAX_AD cuts off the piggybacked history");
+
+struct raw_report {
+    bt_addr_le_t addr;
+    struct scan_meta meta;
+    uint16_t len;
+    uint32_t cycles;  // Reception time
+    uint8_t data[RAW_REPORT_MAX_AD];
+};
+
+static struct raw_report raw_reports[RAW_REPORT_SLOTS];
+static atomic_t raw_head;  // Written by scan_recv only
+static atomic_t raw_tail;  // Written by the parser thread only
+static K_SEM_DEFINE(raw_report_sem, 0, 1);
 
-        // if (name) {
-        //     free(name);
-        //     name = NULL;
-        // }
+static void raw_report_push(const struct bt_le_scan_recv_info *info,
+                            const struct net_buf_simple *ad) {
+    atomic_val_t head = atomic_get(&raw_head);
+
+    if ((uint32_t)(head - atomic_get(&raw_tail)) >= RAW_REPORT_SLOTS) {
+        metrics_inc(METRIC_SCAN_SLAB_DROPS);
+        return;
     }
+
+    struct raw_report *r = &raw_reports[head & (RAW_REPORT_SLOTS - 1)];
+
+    r->cycles = k_cycle_get_32();
+    bt_addr_le_copy(&r->addr, info->addr);
+    scan_meta_from_info(&r->meta, info);
+    r->meta.truncated = ad->len > RAW_REPORT_MAX_AD;
+    r->len = MIN(ad->len, RAW_REPORT_MAX_AD);
+    memcpy(r->data, ad->data, r->len);
+
+    // Publish the slot, atomic_set is a full barrier
+    atomic_set(&raw_head, head + 1);
+    k_sem_give(&raw_report_sem);
 }
 
+static void scan_parser_thread(void) {
+    while (true) {
+        k_sem_take(&raw_report_sem, K_FOREVER);
+
+        atomic_val_t tail = atomic_get(&raw_tail);
+        atomic_val_t head = atomic_get(&raw_head);
+        uint32_t batch = head - tail;
+
+        metrics_max(METRIC_SCAN_BATCH_PEAK, batch);
+
+        for (; tail != head; tail++) {
+            const struct raw_report *r = &raw_reports[tail & (RAW_REPORT_SLOTS - 1)];
+            uint32_t age_us = k_cyc_to_us_floor32(k_cycle_get_32() - r->cycles);
+
+            process_report(&r->addr, &r->meta, r->data, r->len,
+                           k_uptime_get_32() - age_us / 1000,
+                           k_ticks_to_us_floor64(k_uptime_ticks()) - age_us);
+            atomic_set(&raw_tail, tail + 1);
+        }
+    }
+}
+
+K_THREAD_DEFINE(scan_parser_tid, 2048, scan_parser_thread, NULL, NULL, NULL, 4, 0, 0);
+#endif
+
+/*
+ * Scan callback with the full report metadata. The host reassembles chained
+ * extended advertising data (AUX_CHAIN_IND) into CONFIG_BT_EXT_SCAN_BUF_SIZE
+ * before calling it, so ad holds the complete data set of the report.
+ */
+static void scan_recv(const struct bt_le_scan_recv_info *info, struct net_buf_simple *ad) {
+    metrics_inc(METRIC_SCAN_SEEN);
+
+#if SCAN_DEFERRED_PARSE
+    raw_report_push(info, ad);
+#else
+    struct scan_meta meta;
+
+    scan_meta_from_info(&meta, info);
+    process_report(info->addr, &meta, ad->data, ad->len, k_uptime_get_32(),
+                   k_ticks_to_us_floor64(k_uptime_ticks()));
+#endif
+}
+
+static struct bt_le_scan_cb scan_callbacks = {
+    .recv = scan_recv,
+};
+
 // Sdcard functions (different thread)
 #if !defined(CONFIG_BOARD_NRF9160DK_NRF52840)
     #if ROLE
         void append_null(void) {
             struct packet_data pkt;
             pkt = null_pkt;
-            if (k_msgq_put(&packet_msgq, &pkt, K_NO_WAIT) != 0) {
-                        LOG_ERR("Message queue full. Dropping packet.");
-                    }
+            queue_record(&pkt);
 
         }
 
         void append_error(void) {
             struct packet_data pkt;
             pkt = error_pkt;
-            if (k_msgq_put(&packet_msgq, &pkt, K_NO_WAIT) != 0) {
-                        LOG_ERR("Message queue full. Dropping packet.");
-                    }
+            queue_record(&pkt);
 
         }
 
@@ -308,20 +918,28 @@ void scan_cb(const bt_addr_le_t *addr, int8_t rssi, uint8_t type, struct net_buf
             pkt.rx_minute = current_minute;
             pkt.rx_second = current_second;
             pkt.rx_ms = current_ms;
-            if (k_msgq_put(&packet_msgq, &pkt, K_NO_WAIT) != 0) {
-                        LOG_ERR("Message queue full. Dropping packet.");
-                    }
+            queue_record(&pkt);
 
         }
 
         void sdcard_thread(void) {
             struct packet_data pkt;
+
+            // Records stay buffered in the queue until the card is mounted
+            sdcard_wait_ready(K_FOREVER);
+            LOG_INF("Draining %u buffered records to the SD card", k_msgq_num_used_get(&packet_msgq));
+
             while (true) {
-                if (k_msgq_get(&packet_msgq, &pkt, K_FOREVER) == 0) {
+                // Wake up when the oldest unsynced row is due, not a whole interval after the last one
+                if (k_msgq_get(&packet_msgq, &pkt, sync_csv_timeout()) == 0) {
+                    TRACE(TRACE_QUEUE_GET, pkt.number_press);
+                    metrics_set(METRIC_QUEUE_DEPTH, k_msgq_num_used_get(&packet_msgq));
                     // Perform SD card write operation
-                    append_csv(pkt.number_press, pkt.tx_delay, pkt.latitude, pkt.longitude,
-                                pkt.tx_hour, pkt.tx_minute, pkt.tx_second, pkt.tx_ms, pkt.rssi,
-                                pkt.rx_hour, pkt.rx_minute, pkt.rx_second, pkt.rx_ms,pkt.aoi);
+                    append_csv(&pkt);
+                    TRACE(TRACE_CSV_DONE, pkt.number_press);
+                } else {
+                    // Idle: make sure the last rows do not stay unsynced
+                    sync_csv(false);
                 }
             }
         }
@@ -334,4 +952,119 @@ void scan_cb(const bt_addr_le_t *addr, int8_t rssi, uint8_t type, struct net_buf
             LOG_INF("Packet message queue has been reset.");
         }
     #endif
-#endif
\ No newline at end of file
+#endif
+#if defined(CONFIG_SHELL)
+
+static int cmd_scan_phy(const struct shell *sh, size_t argc, char **argv) {
+    uint8_t phys;
+
+    if (strcmp(argv[1], "1m") == 0) {
+        phys = BT_GAP_LE_PHY_1M;
+    } else if (strcmp(argv[1], "coded") == 0) {
+        phys = BT_GAP_LE_PHY_CODED;
+    } else if (strcmp(argv[1], "both") == 0) {
+        phys = BT_GAP_LE_PHY_1M | BT_GAP_LE_PHY_CODED;
+    } else {
+        shell_error(sh, "PHY must be 1m, coded or both");
+        return -EINVAL;
+    }
+
+    scan_set_phy(phys);
+    shell_print(sh, "Scanning on %s from the next scan window", argv[1]);
+    return 0;
+}
+
+/*
+ * Feed synthetic reports of PEER_NODE_ID through scan_recv at doubling rates
+ * and report where scan_slab_drops or queue_drops start, or where the
+ * feeder itself falls behind because inline parsing takes the whole period.
+ * The feeder runs at a cooperative priority like the Bluetooth RX thread and
+ * sleeps between reports. Build with SCAN_DEFERRED_PARSE 0 and 1 to compare.
+ * The reports go through the whole pipeline, with recording on they are
+ * written to the current test file.
+ */
+#define SCAN_BENCH_START_RATE 250 // reports/s, doubled every step
+#define SCAN_BENCH_STEPS 8
+#define SCAN_BENCH_STEP_MS 1000
+
+static int cmd_scan_bench(const struct shell *sh, size_t argc, char **argv) {
+    bt_addr_le_t addr = {.type = BT_ADDR_LE_RANDOM, .a.val = {0x5A, 0x4E, 0x43, 0x42, 0x00, 0xC0}};
+    struct bt_le_scan_recv_info info = {
+        .addr = &addr,
+        .sid = 0,
+        .rssi = -60,
+        .tx_power = BT_GAP_TX_POWER_INVALID,
+        .adv_type = BT_GAP_ADV_TYPE_EXT_ADV,
+        .primary_phy = BT_GAP_LE_PHY_1M,
+        .secondary_phy = BT_GAP_LE_PHY_2M,
+    };
+    struct adv_payload msg = {
+        .header = ADV_HDR_ANCHOR | PEER_NODE_ID,
+        .latitude = 52243187,
+        .longitude = 6856186,
+        .msg_type = ADV_MSG_PERIODIC,
+    };
+    uint8_t ad_buf[2 + ADV_PAYLOAD_MAX_LEN];
+    struct net_buf_simple ad;
+    uint32_t limit = 0;
+    int prio = k_thread_priority_get(k_current_get());
+
+    shell_print(sh, "Scan bench, %s parsing, recording %s", SCAN_DEFERRED_PARSE ? "deferred" : "inline",
+                sd_record ? "on" : "off (reports stop before the SD queue)");
+    k_thread_priority_set(k_current_get(), K_PRIO_COOP(8));
+
+    for (int step = 0; step < SCAN_BENCH_STEPS; step++) {
+        uint32_t rate = SCAN_BENCH_START_RATE << step;
+        uint32_t slab_drops = metrics_get(METRIC_SCAN_SLAB_DROPS);
+        uint32_t queue_drops = metrics_get(METRIC_QUEUE_DROPS);
+        int64_t start = k_uptime_ticks();
+        int64_t span = k_ms_to_ticks_ceil64(SCAN_BENCH_STEP_MS);
+        uint32_t fed = 0;
+
+        while (k_uptime_ticks() - start < span) {
+            msg.number_press = msg.number_press % UINT16_MAX + 1; // 0 is the marker
+            msg.timestamp = get_current_time_packed();
+            ad_buf[1] = BT_DATA_MANUFACTURER_DATA;
+            ad_buf[0] = 1 + adv_payload_pack(&msg, ad_buf + 2);
+            net_buf_simple_init_with_data(&ad, ad_buf, ad_buf[0] + 1);
+            scan_recv(&info, &ad);
+            fed++;
+
+            k_sleep(K_TIMEOUT_ABS_TICKS(start + span * fed / (rate * SCAN_BENCH_STEP_MS / 1000)));
+        }
+
+        uint32_t elapsed_ms = k_ticks_to_ms_floor32(k_uptime_ticks() - start);
+        uint32_t fed_rate = fed * 1000 / MAX(elapsed_ms, 1);
+
+        // Let the parser and the SD writer catch up before counting
+        k_sleep(K_MSEC(SCAN_BENCH_STEP_MS));
+        slab_drops = metrics_get(METRIC_SCAN_SLAB_DROPS) - slab_drops;
+        queue_drops = metrics_get(METRIC_QUEUE_DROPS) - queue_drops;
+
+        shell_print(sh, "%6u/s offered, %6u/s fed, slab drops %u, queue drops %u", rate, fed_rate,
+                    slab_drops, queue_drops);
+        if (slab_drops || queue_drops || fed_rate < rate * 95 / 100) {
+            limit = rate;
+            break;
+        }
+    }
+
+    k_thread_priority_set(k_current_get(), prio);
+    if (limit) {
+        shell_print(sh, "Saturated at %u reports/s, sustainable up to %u", limit, limit / 2);
+    } else {
+        shell_print(sh, "No loss up to %u reports/s", SCAN_BENCH_START_RATE << (SCAN_BENCH_STEPS - 1));
+    }
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(scan_cmds,
+    SHELL_CMD_ARG(phy, NULL, "<1m|coded|both>: primary PHYs to scan", cmd_scan_phy, 2, 0),
+    SHELL_CMD(bench, NULL, "Reports/s the scan pipeline sustains, feeds synthetic peer reports",
+              cmd_scan_bench),
+    SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(scan, &scan_cmds, "Scanner settings", NULL);
+
+#endif
@@ -0,0 +1,208 @@
+#include <stdlib.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/random/random.h>
+#include "ble_settings.h"
+#include "sched_module.h"
+#include "metrics_module.h"
+
+LOG_MODULE_REGISTER(sched_module, LOG_LEVEL_INF);
+
+/*
+ * Peers generate every INTERVAL, so their bursts repeat at a fixed phase of
+ * our own uptime modulo INTERVAL. The phase and its spread are tracked with
+ * a wrap-aware moving average of the first-copy arrivals. A burst that is
+ * ready is held back (while the scanner keeps listening) to the start time
+ * that overlaps least with the predicted peer bursts.
+ */
+struct sched_peer {
+    bool active;
+    uint32_t last_seen;
+    int32_t phase;   // ms in [0, INTERVAL)
+    int32_t spread;  // mean absolute deviation of the arrivals, ms
+    uint16_t last_seq;
+};
+
+static struct sched_peer sched_peers[SCHED_PEERS];
+static struct k_spinlock sched_lock;
+
+/*
+ * Slotted mode, in the spirit of self-organizing TDMA: a node picks a slot
+ * of the superframe that no neighbour is seen starting in. Receivers echo
+ * the id of a node they saw a sequence gap from, and a node that finds its
+ * own id echoed takes it as a collision and moves to another free slot.
+ */
+static int own_slot = -1;
+static uint32_t slot_chosen_at;
+static uint8_t pending_gap_report;
+
+// Wrap a phase difference to [-INTERVAL/2, INTERVAL/2)
+static int32_t phase_wrap(int32_t d) {
+    d %= INTERVAL;
+    if (d >= INTERVAL / 2) {
+        d -= INTERVAL;
+    } else if (d < -INTERVAL / 2) {
+        d += INTERVAL;
+    }
+    return d;
+}
+
+void sched_observe(uint8_t peer, uint32_t uptime_ms, uint16_t seq, uint8_t gap_report) {
+    struct sched_peer *p = &sched_peers[peer % SCHED_PEERS];
+    int32_t arrival = uptime_ms % INTERVAL;
+
+    k_spinlock_key_t key = k_spin_lock(&sched_lock);
+
+    if (!p->active || uptime_ms - p->last_seen > SCHED_STALE_MS) {
+        p->active = true;
+        p->phase = arrival;
+        p->spread = 0;
+    } else {
+        int32_t err = phase_wrap(arrival - p->phase);
+        uint16_t step = seq - p->last_seq;
+
+        p->phase = (p->phase + err / 4 + INTERVAL) % INTERVAL;
+        p->spread += (abs(err) - p->spread) / 4;
+
+        // A skipped sequence number (not a restart) is echoed back to the sender
+        if (step > 1 && step < 0x8000) {
+            pending_gap_report = peer;
+        }
+    }
+    p->last_seen = uptime_ms;
+    p->last_seq = seq;
+
+    // Our own bursts are being missed, move on unless we just did
+    if (gap_report == NODE_ID && own_slot >= 0 &&
+        uptime_ms - slot_chosen_at > SLOT_RESELECT_MIN_MS) {
+        own_slot = -1;
+        metrics_inc(METRIC_SLOT_RESELECTS);
+    }
+
+    k_spin_unlock(&sched_lock, key);
+}
+
+uint8_t sched_gap_report(void) {
+    k_spinlock_key_t key = k_spin_lock(&sched_lock);
+    uint8_t report = pending_gap_report;
+
+    pending_gap_report = 0;
+    k_spin_unlock(&sched_lock, key);
+    return report;
+}
+
+#if SCHED_ADAPTIVE
+// Overlap in ms of our burst starting at `start` with the bursts of peer p
+static int32_t burst_overlap(const struct sched_peer *p, uint32_t start) {
+    int32_t own_start = start % INTERVAL;
+    int32_t peer_start = p->phase - p->spread;
+    int32_t peer_len = SCHED_BURST_MS + 2 * p->spread;
+    int32_t overlap = 0;
+
+    // The bursts can be longer than INTERVAL/2, check the neighbouring periods too
+    for (int32_t k = -1; k <= 1; k++) {
+        int32_t a = MAX(own_start, peer_start + k * INTERVAL);
+        int32_t b = MIN(own_start + SCHED_BURST_MS, peer_start + k * INTERVAL + peer_len);
+
+        if (b > a) {
+            overlap += b - a;
+        }
+    }
+    return overlap;
+}
+#endif
+
+#if SLOTTED_ADV
+// Pick a random slot no active neighbour starts in (nor the slot before), the least used if none
+static int slot_select(uint32_t now_ms) {
+    uint8_t used[SLOT_COUNT] = {0};
+    int free_count = 0;
+    int least = 0;
+
+    for (int i = 0; i < SCHED_PEERS; i++) {
+        const struct sched_peer *p = &sched_peers[i];
+
+        if (p->active && now_ms - p->last_seen <= SCHED_STALE_MS) {
+            int slot = p->phase / SLOT_MS;
+
+            used[slot]++;
+            used[(slot + SLOT_COUNT - 1) % SLOT_COUNT]++;
+        }
+    }
+    for (int i = 0; i < SLOT_COUNT; i++) {
+        free_count += (used[i] == 0);
+        if (used[i] < used[least]) {
+            least = i;
+        }
+    }
+    if (free_count == 0) {
+        return least;
+    }
+
+    int pick = sys_rand32_get() % free_count;
+
+    for (int i = 0; i < SLOT_COUNT; i++) {
+        if (used[i] == 0 && pick-- == 0) {
+            return i;
+        }
+    }
+    return least;
+}
+#endif
+
+uint32_t sched_adv_delay(uint32_t now_ms) {
+#if SLOTTED_ADV
+    k_spinlock_key_t key = k_spin_lock(&sched_lock);
+
+    if (own_slot < 0) {
+        own_slot = slot_select(now_ms);
+        slot_chosen_at = now_ms;
+        LOG_INF("Advertising slot %d of %d", own_slot, SLOT_COUNT);
+    }
+
+    uint32_t delay = (own_slot * SLOT_MS + INTERVAL - now_ms % INTERVAL) % INTERVAL;
+
+    k_spin_unlock(&sched_lock, key);
+
+    if (delay) {
+        metrics_inc(METRIC_SCHED_HOLDS);
+        metrics_add(METRIC_SCHED_HOLD_MS, delay);
+    }
+    return delay;
+#elif SCHED_ADAPTIVE
+    uint32_t best_delay = 0;
+    int32_t best_overlap = INT32_MAX;
+
+    k_spinlock_key_t key = k_spin_lock(&sched_lock);
+
+    for (uint32_t delay = 0; delay <= SCHED_MAX_HOLD_MS; delay += SCHED_STEP_MS) {
+        int32_t overlap = 0;
+
+        for (int i = 0; i < SCHED_PEERS; i++) {
+            const struct sched_peer *p = &sched_peers[i];
+
+            if (p->active && now_ms - p->last_seen <= SCHED_STALE_MS) {
+                overlap += burst_overlap(p, now_ms + delay);
+            }
+        }
+        if (overlap < best_overlap) {
+            best_overlap = overlap;
+            best_delay = delay;
+        }
+        if (overlap == 0) {
+            break;
+        }
+    }
+
+    k_spin_unlock(&sched_lock, key);
+
+    if (best_delay) {
+        LOG_DBG("Burst held %u ms, predicted overlap %d ms", best_delay, best_overlap);
+        metrics_inc(METRIC_SCHED_HOLDS);
+        metrics_add(METRIC_SCHED_HOLD_MS, best_delay);
+    }
+    return best_delay;
+#else
+    return 0;
+#endif
+}
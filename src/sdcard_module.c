@@ -2,12 +2,16 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
+#include <errno.h>
 #include <zephyr/kernel.h>
 #include <zephyr/device.h>
 #include <zephyr/storage/disk_access.h>
 #include <zephyr/logging/log.h>
 #include <zephyr/fs/fs.h>
 #include "sdcard_module.h"
+#include "csv_format.h"
+#include "ble_settings.h"
+#include "metrics_module.h"
 
 #if defined(CONFIG_FAT_FILESYSTEM_ELM)
 
@@ -41,32 +45,508 @@ static struct fs_mount_t mp = {
 
 LOG_MODULE_REGISTER(sdcard_module);
 
+/* Rows are collected into sector sized chunks before reaching the disk */
+#define CSV_SECTOR_SIZE 512
+
+/* Expected size of one test: TEST_PERIOD worth of rows plus some margin */
+#define CSV_ROW_EST_LEN 80
+#define CSV_PREALLOC_BYTES ((TEST_PERIOD * 1000 / INTERVAL) * CSV_ROW_EST_LEN * 3 / 2)
+
+/* Last used file index of the test folder, avoids a directory scan at boot */
+#define CSV_INDEX_FILE "index"
+
+/* Recovery reads back from the end of the data in windows of this size, longer than any row */
+#define CSV_RECOVERY_WINDOW 512
+BUILD_ASSERT(CSV_RECOVERY_WINDOW > CSV_ROW_MAX_LEN, "a row must fit in the recovery window");
+
+/* Write latency histogram, bucket i counts writes that took [2^i, 2^(i+1)) us */
+#define WRITE_LAT_BUCKETS 21
+
 static const char *disk_mount_pt = DISK_MOUNT_PT;
 static int file_index = -1;
 
+/* Currently open test file */
+static struct fs_file_t csv_file;
+static bool csv_open = false;
+static char csv_path[150];
+static off_t csv_flushed = 0;    // Bytes of complete sectors already on disk
+static off_t csv_allocated = 0;  // Current preallocated file size
+static bool csv_prealloc_ok = false;  // Preallocation works on this file, else rows are plain appends
+
+static uint8_t sector_buf[CSV_SECTOR_SIZE] __aligned(4);
+static size_t sector_fill = 0;
+
+/* Durability policy state */
+static uint32_t rows_unsynced = 0;
+static uint32_t last_sync_time = 0;
+
+static uint32_t write_lat_hist[WRITE_LAT_BUCKETS];
+static uint32_t write_lat_max_us = 0;
+
 void (*error_handler)(const char *error_message) = NULL;
 
 void set_error_handler(void (*handler)(const char *)) {
     error_handler = handler;
 }
 
-int create_csv(void)
+/*
+ * Drop a torn tail from a file left behind by a power loss: the unused
+ * preallocated zeros and all trailing rows up to the last one that is
+ * complete and passes its checksum.
+ */
+static int recover_csv(const char *path)
 {
-    char csv_folder_path[150];
-    char csv_file_path[150];
     struct fs_file_t file;
-    struct fs_dir_t dir;
-    struct fs_dirent entry;
+    char window[CSV_RECOVERY_WINDOW];
+    uint8_t first;
+    off_t size;
     int res;
 
     fs_file_t_init(&file);
+    res = fs_open(&file, path, FS_O_RDWR);
+    if (res < 0) {
+        return res;
+    }
+
+    res = fs_seek(&file, 0, FS_SEEK_END);
+    size = fs_tell(&file);
+    if (res < 0 || size <= 0) {
+        goto out;
+    }
+
+    /*
+     * Rows never contain a NUL byte, so the first sector starting with one
+     * is past the data. Binary search for it instead of reading everything.
+     */
+    uint32_t lo = 0;
+    uint32_t hi = DIV_ROUND_UP(size, CSV_SECTOR_SIZE);
+
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+
+        fs_seek(&file, (off_t)mid * CSV_SECTOR_SIZE, FS_SEEK_SET);
+        if (fs_read(&file, &first, 1) == 1 && first != 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    if (lo == 0) {
+        /* Nothing but preallocated zeros */
+        res = fs_truncate(&file, 0);
+        goto out;
+    }
+
+    /* Exact end of the data inside the last used sector */
+    off_t data_end = (off_t)(lo - 1) * CSV_SECTOR_SIZE;
+
+    fs_seek(&file, data_end, FS_SEEK_SET);
+    ssize_t len = fs_read(&file, window, MIN(CSV_SECTOR_SIZE, size - data_end));
+
+    if (len <= 0) {
+        res = len;
+        goto out;
+    }
+
+    char *nul = memchr(window, '\0', len);
+
+    data_end += nul ? nul - window : len;
+
+    /*
+     * Walk back over the rows, a window at a time, until one checks out.
+     * Everything after it goes, a row that fails its checksum is never
+     * kept. Rows are shorter than the window, so a row cut by the window
+     * start is checked again as the last row of the previous window.
+     */
+    off_t keep = 0;
+    off_t end = data_end;
+
+    while (end > 0) {
+        off_t window_start = MAX(end - CSV_RECOVERY_WINDOW, 0);
+        ssize_t first_nl = -1;
+
+        fs_seek(&file, window_start, FS_SEEK_SET);
+        len = fs_read(&file, window, end - window_start);
+        if (len <= 0) {
+            res = len;
+            goto out;
+        }
+
+        ssize_t line_end = len - 1;
+
+        while (line_end >= 0 && keep == 0) {
+            while (line_end >= 0 && window[line_end] != '\n') {
+                line_end--;
+            }
+            if (line_end < 0) {
+                break;
+            }
+
+            ssize_t line_start = line_end - 1;
+
+            while (line_start >= 0 && window[line_start] != '\n') {
+                line_start--;
+            }
+            if (line_start < 0 && window_start > 0) {
+                /* Starts before the window, checked with the previous one */
+                first_nl = line_end;
+                break;
+            }
+            line_start++;
+
+            if (csv_row_valid(&window[line_start], line_end - line_start)) {
+                keep = window_start + line_end + 1;
+            }
+            line_end = line_start - 1;
+        }
+
+        if (keep > 0) {
+            break;
+        }
+        /* A row that does not fit in a whole window is garbage, step over it */
+        end = first_nl >= 0 && first_nl < len - 1 ? window_start + first_nl + 1 : window_start;
+    }
+
+    if (keep < size) {
+        res = fs_truncate(&file, keep);
+        LOG_WRN("Recovered %s: kept %d bytes, dropped %d", path, (int)keep, (int)(size - keep));
+    }
+
+out:
+    fs_close(&file);
+    return res;
+}
+
+static void record_write_latency(uint32_t us)
+{
+    uint32_t bucket = us ? MIN(31 - __builtin_clz(us), WRITE_LAT_BUCKETS - 1) : 0;
+
+    write_lat_hist[bucket]++;
+    if (us > write_lat_max_us) {
+        write_lat_max_us = us;
+    }
+}
+
+/* Upper bound of the bucket holding the given percentile */
+static uint32_t write_latency_percentile(uint32_t total, uint32_t percent)
+{
+    uint32_t target = (total * percent + 99) / 100;
+    uint32_t seen = 0;
+
+    for (int i = 0; i < WRITE_LAT_BUCKETS; i++) {
+        seen += write_lat_hist[i];
+        if (seen >= target) {
+            return MIN(1U << (i + 1), write_lat_max_us);
+        }
+    }
+    return write_lat_max_us;
+}
+
+static void log_write_latency(void)
+{
+    uint32_t total = 0;
+
+    for (int i = 0; i < WRITE_LAT_BUCKETS; i++) {
+        total += write_lat_hist[i];
+    }
+    if (total == 0) {
+        return;
+    }
+
+    LOG_INF("SD write latency: %u writes, p50 <= %u us, p99 <= %u us, max %u us (prealloc %s)",
+            total, write_latency_percentile(total, 50), write_latency_percentile(total, 99),
+            write_lat_max_us, csv_prealloc_ok ? "on" : "off");
+
+    memset(write_lat_hist, 0, sizeof(write_lat_hist));
+    write_lat_max_us = 0;
+}
+
+#if CSV_PREALLOC
+/* Grow the file to at least `size` bytes, rounded up to whole clusters */
+static int csv_preallocate(off_t size)
+{
+    size_t cluster = CSV_SECTOR_SIZE;
+    int res;
+
+#if defined(CONFIG_FAT_FILESYSTEM_ELM)
+    cluster = (size_t)fat_fs.csize * CSV_SECTOR_SIZE;
+#endif
+    size = ROUND_UP(size, cluster);
+
+    /* Zero fills the new clusters, the FAT chain is built here and not in the write path */
+    res = fs_truncate(&csv_file, size);
+    if (res < 0) {
+        return res;
+    }
+
+    /* On a full volume FatFs extends as far as it can and still reports success */
+    res = fs_seek(&csv_file, 0, FS_SEEK_END);
+    if (res < 0) {
+        return res;
+    }
+    csv_allocated = fs_tell(&csv_file);
+    if (csv_allocated < size) {
+        LOG_WRN("Preallocated %d of %d bytes", (int)csv_allocated, (int)size);
+        fs_seek(&csv_file, csv_flushed, FS_SEEK_SET);
+        return -ENOSPC;
+    }
+
+    return fs_seek(&csv_file, csv_flushed, FS_SEEK_SET);
+}
+#endif
+
+/*
+ * Write the pending sector at its aligned offset. A partial sector is written
+ * as well but kept in the buffer, so it is rewritten once it fills up.
+ */
+static int csv_flush(void)
+{
+    int res;
+
+    if (sector_fill == 0) {
+        return 0;
+    }
+
+#if CSV_PREALLOC
+    if (csv_prealloc_ok && csv_flushed + CSV_SECTOR_SIZE > csv_allocated) {
+        /* Test ran longer than expected, extend by another test worth of space */
+        res = csv_preallocate(csv_allocated + CSV_PREALLOC_BYTES);
+        if (res < 0) {
+            /* The rows still fit by growing the file on every write */
+            LOG_WRN("Failed to extend %s (err: %d), appending instead", csv_path, res);
+            csv_prealloc_ok = false;
+        }
+    }
+#endif
+
+    res = fs_seek(&csv_file, csv_flushed, FS_SEEK_SET);
+    if (res < 0) {
+        return res;
+    }
+
+    uint32_t start = k_cycle_get_32();
+    ssize_t written = fs_write(&csv_file, sector_buf, sector_fill);
+    uint32_t latency_us = k_cyc_to_us_floor32(k_cycle_get_32() - start);
+
+    record_write_latency(latency_us);
+    metrics_inc(METRIC_SD_WRITES);
+    metrics_add(METRIC_SD_WRITE_US, latency_us);
+    metrics_max(METRIC_SD_WRITE_MAX_US, latency_us);
+    if (written < 0) {
+        return written;
+    }
+
+    if (sector_fill == CSV_SECTOR_SIZE) {
+        csv_flushed += CSV_SECTOR_SIZE;
+        sector_fill = 0;
+    }
+    return 0;
+}
+
+/*
+ * Durability policy: buffered rows are written out and the FAT metadata is
+ * committed every CSV_SYNC_ROWS rows or CSV_SYNC_INTERVAL_MS, whichever comes
+ * first. That bounds what a power loss can take to one sync period.
+ */
+int sync_csv(bool force)
+{
+    uint32_t now = k_uptime_get_32();
+    int res;
+
+    if (!csv_open || rows_unsynced == 0) {
+        return 0;
+    }
+    if (!force && rows_unsynced < CSV_SYNC_ROWS &&
+        (now - last_sync_time) < CSV_SYNC_INTERVAL_MS) {
+        return 0;
+    }
+
+    res = csv_flush();
+    if (res < 0) {
+        return res;
+    }
+    res = fs_sync(&csv_file);
+    if (res < 0) {
+        return res;
+    }
+
+    rows_unsynced = 0;
+    last_sync_time = now;
+    return 0;
+}
+
+/* Time until the unsynced rows are due, for a writer that waits for more rows */
+k_timeout_t sync_csv_timeout(void)
+{
+    uint32_t elapsed = k_uptime_get_32() - last_sync_time;
+
+    if (!csv_open || rows_unsynced == 0) {
+        return K_FOREVER;
+    }
+    if (elapsed >= CSV_SYNC_INTERVAL_MS) {
+        return K_NO_WAIT;
+    }
+    return K_MSEC(CSV_SYNC_INTERVAL_MS - elapsed);
+}
+
+static int csv_write(const char *data, size_t len)
+{
+    while (len > 0) {
+        size_t chunk = MIN(len, CSV_SECTOR_SIZE - sector_fill);
+
+        memcpy(&sector_buf[sector_fill], data, chunk);
+        sector_fill += chunk;
+        data += chunk;
+        len -= chunk;
+
+        if (sector_fill == CSV_SECTOR_SIZE) {
+            int res = csv_flush();
+
+            if (res < 0) {
+                return res;
+            }
+        }
+    }
+    return 0;
+}
+
+/* Flush the open test file and trim the preallocated tail */
+int close_csv(void)
+{
+    int res;
+
+    if (!csv_open) {
+        return 0;
+    }
+
+    res = csv_flush();
+    if (res < 0) {
+        LOG_ERR("Failed to flush %s (err: %d)", csv_path, res);
+    }
+
+#if CSV_PREALLOC
+    res = fs_truncate(&csv_file, csv_flushed + sector_fill);
+    if (res < 0) {
+        LOG_ERR("Failed to trim %s (err: %d)", csv_path, res);
+    }
+#endif
+
+    fs_close(&csv_file);
+    csv_open = false;
+    log_write_latency();
+
+    return res;
+}
+
+/* Read the last used file index kept in the test folder, -1 if missing or unreadable */
+static int read_index_file(const char *folder)
+{
+    char path[150];
+    char text[12] = {0};
+    struct fs_file_t file;
+    int index;
+
+    snprintf(path, sizeof(path), "%s/%s", folder, CSV_INDEX_FILE);
+    fs_file_t_init(&file);
+    if (fs_open(&file, path, FS_O_READ) < 0) {
+        return -1;
+    }
+
+    ssize_t len = fs_read(&file, text, sizeof(text) - 1);
+
+    fs_close(&file);
+    if (len <= 0 || sscanf(text, "%d", &index) != 1 || index < 0) {
+        return -1;
+    }
+    return index;
+}
+
+static int write_index_file(const char *folder, int index)
+{
+    char path[150];
+    char text[12];
+    struct fs_file_t file;
+    int res;
+
+    snprintf(path, sizeof(path), "%s/%s", folder, CSV_INDEX_FILE);
+    fs_file_t_init(&file);
+    res = fs_open(&file, path, FS_O_WRITE | FS_O_CREATE);
+    if (res < 0) {
+        return res;
+    }
+
+    int len = snprintf(text, sizeof(text), "%d\n", index);
+
+    res = fs_truncate(&file, 0);
+    if (res == 0) {
+        ssize_t written = fs_write(&file, text, len);
+
+        res = written < 0 ? written : 0;
+    }
+    fs_close(&file);
+    return res;
+}
+
+/*
+ * The stored index is trusted only if N.csv exists and N+1.csv does not,
+ * anything else (old card, crash between creating a file and updating the
+ * index, files copied in by hand) falls back to the directory scan.
+ */
+static bool index_consistent(const char *folder, int index)
+{
+    char path[150];
+    struct fs_dirent entry;
+
+    snprintf(path, sizeof(path), "%s/%d.csv", folder, index);
+    if (fs_stat(path, &entry) != 0) {
+        return false;
+    }
+    snprintf(path, sizeof(path), "%s/%d.csv", folder, index + 1);
+    return fs_stat(path, &entry) != 0;
+}
+
+/* Slow path: scan the folder to find the highest file index */
+static int scan_highest_index(const char *folder)
+{
+    struct fs_dir_t dir;
+    struct fs_dirent entry;
+    int highest = -1;
+
     fs_dir_t_init(&dir);
+    if (fs_opendir(&dir, folder) < 0) {
+        return -1;
+    }
+
+    while (fs_readdir(&dir, &entry) == 0 && entry.name[0] != '\0') {
+        int current_index;
+        if (sscanf(entry.name, "%d.csv", &current_index) == 1) {
+            if (current_index > highest) {
+                highest = current_index;
+            }
+        }
+    }
+    fs_closedir(&dir);
+
+    return highest;
+}
+
+int create_csv(void)
+{
+    char csv_folder_path[150];
+    struct fs_dirent entry;
+    int res;
+
+    /* Rotation: finish the previous file first */
+    close_csv();
+
+    fs_file_t_init(&csv_file);
 
     /* Construct the folder path */
     snprintf(csv_folder_path, sizeof(csv_folder_path), "%s/%s", disk_mount_pt, CSV_TEST_NAME);
 
     /* Check if the folder exists */
-    res = fs_opendir(&dir, csv_folder_path);
+    res = fs_stat(csv_folder_path, &entry);
     if (res < 0) {
         /* Folder doesn't exist, create it */
         LOG_INF("Folder %s does not exist. Creating new folder.", csv_folder_path);
@@ -74,66 +554,83 @@ int create_csv(void)
         res = fs_mkdir(csv_folder_path);
         if (res < 0) {
             LOG_ERR("Failed to create folder %s (err: %d)", csv_folder_path, res);
-            if (error_handler) {
-                error_handler("Failed to create folder");
-            }
             return -1;
         }
     } else {
-        /* Scan folder to find the highest file index */
-        while (fs_readdir(&dir, &entry) == 0 && entry.name[0] != '\0') {
-            int current_index;
-            if (sscanf(entry.name, "%d.csv", &current_index) == 1) {
-                if (current_index > file_index) {
-                    file_index = current_index;
-                }
-            }
+        int stored_index = read_index_file(csv_folder_path);
+
+        if (stored_index >= 0 && index_consistent(csv_folder_path, stored_index)) {
+            file_index = MAX(file_index, stored_index);
+        } else {
+            uint32_t start = k_uptime_get_32();
+            int scanned_index = scan_highest_index(csv_folder_path);
+
+            LOG_WRN("Index file missing or stale (%d), scanned folder in %u ms: last file %d",
+                    stored_index, k_uptime_get_32() - start, scanned_index);
+            file_index = MAX(file_index, scanned_index);
+        }
+    }
+
+    /* The previous file may have been cut short by a power loss */
+    if (file_index >= 0) {
+        char last_path[150];
+
+        snprintf(last_path, sizeof(last_path), "%s/%d.csv", csv_folder_path, file_index);
+        res = recover_csv(last_path);
+        if (res < 0) {
+            LOG_WRN("Recovery of %s failed (err: %d)", last_path, res);
         }
-        fs_closedir(&dir);
     }
 
     /* Increment file_index for the new file */
     file_index++;
 
     /* Construct the new file path */
-    snprintf(csv_file_path, sizeof(csv_file_path), "%s/%d.csv", csv_folder_path, file_index);
+    snprintf(csv_path, sizeof(csv_path), "%s/%d.csv", csv_folder_path, file_index);
 
-    /* Create the new file */
-    res = fs_open(&file, csv_file_path, FS_O_WRITE | FS_O_CREATE);
+    /* Create the new file, it stays open until the next rotation */
+    res = fs_open(&csv_file, csv_path, FS_O_RDWR | FS_O_CREATE);
     if (res < 0) {
-        LOG_ERR("Failed to create file %s (err: %d)", csv_file_path, res);
-        if (error_handler) {
-            error_handler("Failed to create file");
-        }
+        LOG_ERR("Failed to create file %s (err: %d)", csv_path, res);
         return -1;
     }
 
-    LOG_INF("Created file: %s", csv_file_path);
+    csv_flushed = 0;
+    csv_allocated = 0;
+    csv_prealloc_ok = false;
+    sector_fill = 0;
+    rows_unsynced = 0;
+    last_sync_time = k_uptime_get_32();
+
+#if CSV_PREALLOC
+    res = csv_preallocate(CSV_PREALLOC_BYTES);
+    if (res < 0) {
+        /* Not fatal, csv_flush() then grows the file on demand */
+        LOG_WRN("Failed to preallocate %s (err: %d)", csv_path, res);
+    } else {
+        csv_prealloc_ok = true;
+    }
+#endif
+
+    csv_open = true;
+    LOG_INF("Created file: %s (sync every %d rows or %d ms)", csv_path,
+            CSV_SYNC_ROWS, CSV_SYNC_INTERVAL_MS);
+
+    res = write_index_file(csv_folder_path, file_index);
+    if (res < 0) {
+        /* Only costs a directory scan on the next boot */
+        LOG_WRN("Failed to update %s index (err: %d)", CSV_INDEX_FILE, res);
+    }
 
-    /* Close the file */
-    fs_close(&file);
     return 0;
 }
 
 /* Append to a CSV file */
-int append_csv(uint16_t number_press, uint16_t tx_delay, uint32_t latitude, uint32_t longitude, 
-              uint8_t tx_hour, uint8_t tx_minute, uint8_t tx_second, uint16_t tx_ms,int8_t rssi,
-              uint8_t rx_hour, uint8_t rx_minute, uint8_t rx_second, uint16_t rx_ms, uint32_t aoi) {
-    char csv_folder_path[128];
-    char csv_file_path[128];
-    struct fs_file_t file;
+int append_csv(const struct packet_data *pkt) {
     int res;
 
-    fs_file_t_init(&file);
-
-    /* Construct the full file path */
-    snprintf(csv_folder_path, sizeof(csv_folder_path), "%s/%s", disk_mount_pt, CSV_TEST_NAME);
-    snprintf(csv_file_path, sizeof(csv_file_path), "%s/%d.csv", csv_folder_path, file_index);
-
-    /* Open file for appending */
-    res = fs_open(&file, csv_file_path,  FS_O_WRITE | FS_O_APPEND );
-    if (res < 0) {
-        LOG_ERR("Failed to open file %s for appending (err: %d)", csv_file_path, res);
+    if (!csv_open) {
+        LOG_ERR("No open file for appending");
         if (error_handler) {
             error_handler("Failed to open to append file");
         }
@@ -141,29 +638,34 @@ int append_csv(uint16_t number_press, uint16_t tx_delay, uint32_t latitude, uint
     }
 
     /* Append a new row */
-    char buffer[124];
+    char buffer[CSV_ROW_MAX_LEN];
 
-    // timestamp_id, timestamp_tx, tx_delay,timestamp_rx, number_press, latitude, longitude, rssi, aoi
-    int written = snprintf(buffer, sizeof(buffer), "%02u%02u%02u%03u,%02u:%02u:%02u.%03u,%u,%02u:%02u:%02u.%03u,%u,%u,%u,%d,%u\n",
-                        tx_hour, tx_minute, tx_second, tx_ms, tx_hour, tx_minute, tx_second, tx_ms,tx_delay,
-                        rx_hour, rx_minute, rx_second, rx_ms,number_press,latitude,longitude, rssi, aoi);
+    // timestamp_id, timestamp_tx, tx_delay,timestamp_rx, number_press, latitude, longitude, rssi, aoi, copies, copy_spread, hops, origin, msg_type, chan_map, primary_phy, secondary_phy, sid, tx_power, truncated, recovered
+    int written = csv_format_row(buffer, pkt);
 
-    res = fs_write(&file, buffer, written);
+    res = csv_write(buffer, written);
     if (res < 0) {
-        LOG_ERR("Failed to append data to %s (err: %d)", csv_file_path, res);
+        LOG_ERR("Failed to append data to %s (err: %d)", csv_path, res);
         if (error_handler) {
             error_handler("Failed to append to file");
         }
-        fs_close(&file);
         return false;
     } 
+
+    rows_unsynced++;
+    metrics_inc(METRIC_SD_ROWS);
+    res = sync_csv(false);
+    if (res < 0) {
+        LOG_ERR("Failed to sync %s (err: %d)", csv_path, res);
+        if (error_handler) {
+            error_handler("Failed to sync file");
+        }
+        return false;
+    }
   // else {
   //     LOG_INF("Data appended to CSV file: %s", buffer);
   // }
 
- 
-
-    fs_close(&file);
     return 0;
 }
 
@@ -224,6 +726,61 @@ int sdcard_init(void)
 }
 
 int disk_unmount(void){
+  close_csv();
   fs_unmount(&mp);
+  file_index = -1; // The next card may be another one, its index is read again
   return 0;
 }
+
+/* Background mount, so a slow or missing card does not hold up the radio */
+static K_SEM_DEFINE(storage_ready_sem, 0, 1);
+static bool storage_ready = false;
+
+#define CSV_CREATE_RETRY_MS 1000
+#define CSV_CREATE_RETRY_MAX_MS 30000
+
+static void sdcard_mount_thread(void)
+{
+    uint32_t start = k_uptime_get_32();
+    uint32_t backoff = CSV_CREATE_RETRY_MS;
+
+    sdcard_init();   // Retries until the card shows up
+
+    // Records stay in the queue meanwhile, main is not told as it would throw them away
+    while (create_csv() != 0) {
+        LOG_ERR("CSV file not created, retrying in %u ms", backoff);
+        k_sleep(K_MSEC(backoff));
+        backoff = MIN(backoff * 2, CSV_CREATE_RETRY_MAX_MS);
+    }
+
+    storage_ready = true;
+    k_sem_give(&storage_ready_sem);
+    LOG_INF("Storage ready after %u ms (%u ms since boot)", k_uptime_get_32() - start,
+            k_uptime_get_32());
+}
+
+K_THREAD_DEFINE(sdcard_mount_tid, 2048, sdcard_mount_thread, NULL, NULL, NULL, 7, 0, SYS_FOREVER_MS);
+
+void sdcard_init_async(void)
+{
+    k_thread_start(sdcard_mount_tid);
+}
+
+bool sdcard_is_ready(void)
+{
+    return storage_ready;
+}
+
+int sdcard_wait_ready(k_timeout_t timeout)
+{
+    if (storage_ready) {
+        return 0;
+    }
+
+    int err = k_sem_take(&storage_ready_sem, timeout);
+
+    if (err == 0) {
+        k_sem_give(&storage_ready_sem); // Let the other waiters through
+    }
+    return err;
+}
@@ -0,0 +1,123 @@
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/atomic.h>
+#if defined(CONFIG_TIMING_FUNCTIONS)
+#include <zephyr/timing/timing.h>
+#endif
+#include "trace_module.h"
+
+LOG_MODULE_REGISTER(trace_module, LOG_LEVEL_INF);
+
+#if PIPELINE_TRACE
+
+BUILD_ASSERT((TRACE_RING_LEN & (TRACE_RING_LEN - 1)) == 0, "TRACE_RING_LEN must be a power of two");
+
+// Per-CPU ring, writers only reserve a slot with an atomic increment
+struct trace_ring {
+    atomic_t head;
+    struct trace_event events[TRACE_RING_LEN];
+};
+
+static struct trace_ring rings[CONFIG_MP_MAX_NUM_CPUS];
+
+static inline uint32_t trace_cycles(void) {
+#if defined(CONFIG_TIMING_FUNCTIONS)
+    return (uint32_t)timing_counter_get();
+#else
+    return k_cycle_get_32();
+#endif
+}
+
+static uint32_t trace_freq_hz(void) {
+#if defined(CONFIG_TIMING_FUNCTIONS)
+    return timing_freq_get_mhz() * 1000000U;
+#else
+    return sys_clock_hw_cycles_per_sec();
+#endif
+}
+
+void trace_record(enum trace_point point, uint16_t seq) {
+    uint8_t cpu = 0;
+
+#if CONFIG_MP_MAX_NUM_CPUS > 1
+    cpu = arch_curr_cpu()->id;
+#endif
+    struct trace_ring *ring = &rings[cpu];
+    uint32_t slot = (uint32_t)atomic_inc(&ring->head) & (TRACE_RING_LEN - 1);
+    struct trace_event *ev = &ring->events[slot];
+
+    ev->cycles = trace_cycles();
+    ev->seq = seq;
+    ev->point = point;
+    ev->cpu = cpu;
+}
+
+#endif // PIPELINE_TRACE
+
+int trace_init(void) {
+#if defined(CONFIG_TIMING_FUNCTIONS)
+    // Left running for good, the shell benches read the same counter
+    timing_init();
+    timing_start();
+#endif
+    return 0;
+}
+
+#if defined(CONFIG_SHELL) && PIPELINE_TRACE
+
+/*
+ * Compact binary stream, hex encoded so it survives the console:
+ *   TRACE BEGIN <version> <cpus> <cycle freq hz>
+ *   TRACE CPU <cpu> <events>
+ *   <up to 8 raw little endian trace_event structs per line>
+ *   TRACE END
+ * scripts/trace_hist.py turns a captured log into per-stage histograms.
+ */
+static int cmd_trace_dump(const struct shell *sh, size_t argc, char **argv) {
+    shell_print(sh, "TRACE BEGIN 1 %u %u", CONFIG_MP_MAX_NUM_CPUS, trace_freq_hz());
+
+    for (int cpu = 0; cpu < CONFIG_MP_MAX_NUM_CPUS; cpu++) {
+        struct trace_ring *ring = &rings[cpu];
+        uint32_t head = (uint32_t)atomic_get(&ring->head);
+        uint32_t count = MIN(head, TRACE_RING_LEN);
+        uint32_t first = head - count;   // Oldest event still in the ring
+
+        shell_print(sh, "TRACE CPU %d %u", cpu, count);
+
+        for (uint32_t i = 0; i < count; i += 8) {
+            char line[8 * sizeof(struct trace_event) * 2 + 1];
+            uint32_t n = MIN(8, count - i);
+            char *p = line;
+
+            for (uint32_t j = 0; j < n; j++) {
+                const struct trace_event *ev =
+                    &ring->events[(first + i + j) & (TRACE_RING_LEN - 1)];
+
+                p += bin2hex((const uint8_t *)ev, sizeof(*ev), p, line + sizeof(line) - p);
+            }
+            shell_print(sh, "%s", line);
+        }
+    }
+
+    shell_print(sh, "TRACE END");
+    return 0;
+}
+
+static int cmd_trace_clear(const struct shell *sh, size_t argc, char **argv) {
+    for (int cpu = 0; cpu < CONFIG_MP_MAX_NUM_CPUS; cpu++) {
+        atomic_clear(&rings[cpu].head);
+    }
+    shell_print(sh, "Trace cleared");
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(trace_cmds,
+    SHELL_CMD(dump, NULL, "Dump the trace rings as a hex encoded binary stream", cmd_trace_dump),
+    SHELL_CMD(clear, NULL, "Drop all recorded trace events", cmd_trace_clear),
+    SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(trace, &trace_cmds, "Per-packet pipeline trace", NULL);
+
+#endif
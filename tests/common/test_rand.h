@@ -0,0 +1,21 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef TEST_RAND_H
+#define TEST_RAND_H
+
+#include <stdint.h>
+
+/* xorshift32 for the test suites, a fixed seed keeps failures reproducible */
+static uint32_t rand_state;
+
+static inline uint32_t rand_next(void)
+{
+    rand_state ^= rand_state << 13;
+    rand_state ^= rand_state >> 17;
+    rand_state ^= rand_state << 5;
+    return rand_state;
+}
+
+#endif // TEST_RAND_H
@@ -0,0 +1,181 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <zephyr/ztest.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/timing/timing.h>
+#include "csv_format.h"
+#include "test_rand.h"
+
+#define CSV_RANDOM_ROWS 100000
+#define CSV_BENCH_ROWS 5000
+#define CSV_SEED 0x2545F491
+
+/* The snprintf encoder csv_format_row() replaced, kept as the reference */
+static int reference_row(char *buf, size_t size, const struct packet_data *pkt)
+{
+    int len = snprintf(buf, size,
+                       "%02u%02u%02u%03u,%02u:%02u:%02u.%03u,%u,%02u:%02u:%02u.%03u,%u,%u,%u,%d,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%d,%u,%u",
+                       pkt->tx_hour, pkt->tx_minute, pkt->tx_second, pkt->tx_ms,
+                       pkt->tx_hour, pkt->tx_minute, pkt->tx_second, pkt->tx_ms, pkt->tx_delay,
+                       pkt->rx_hour, pkt->rx_minute, pkt->rx_second, pkt->rx_ms,
+                       pkt->number_press, pkt->latitude, pkt->longitude, pkt->rssi, pkt->aoi,
+                       pkt->copies, pkt->copy_spread, pkt->hops, pkt->origin, pkt->msg_type,
+                       pkt->chan_map, pkt->primary_phy, pkt->secondary_phy, pkt->sid,
+                       pkt->tx_power, pkt->truncated, pkt->recovered);
+
+#if CSV_ROW_CHECKSUM
+    len += snprintf(buf + len, size - len, ",%02X", crc8_ccitt(0, buf, len));
+#endif
+    len += snprintf(buf + len, size - len, "\n");
+    return len;
+}
+
+/* Full range values half of the time, values around the padding widths otherwise */
+static uint32_t rand_value(void)
+{
+    uint32_t r = rand_next();
+
+    switch (rand_next() % 4) {
+    case 0:
+        return r % 10;
+    case 1:
+        return r % 1100;
+    default:
+        return r;
+    }
+}
+
+static void random_packet(struct packet_data *pkt)
+{
+    *pkt = (struct packet_data){
+        .number_press = rand_value(),
+        .tx_delay = rand_value(),
+        .latitude = rand_value(),
+        .longitude = rand_value(),
+        .tx_hour = rand_value(),
+        .tx_minute = rand_value(),
+        .tx_second = rand_value(),
+        .tx_ms = rand_value(),
+        .rx_hour = rand_value(),
+        .rx_minute = rand_value(),
+        .rx_second = rand_value(),
+        .rx_ms = rand_value(),
+        .rssi = rand_value(),
+        .aoi = rand_value(),
+        .copies = rand_value(),
+        .copy_spread = rand_value(),
+        .hops = rand_value(),
+        .origin = rand_value(),
+        .msg_type = rand_value(),
+        .chan_map = rand_value(),
+        .primary_phy = rand_value(),
+        .secondary_phy = rand_value(),
+        .sid = rand_value(),
+        .tx_power = rand_value(),
+        .truncated = rand_value(),
+        .recovered = rand_value(),
+    };
+}
+
+ZTEST(csv_format, test_matches_snprintf)
+{
+    struct packet_data pkt;
+    char row[CSV_ROW_MAX_LEN];
+    char expected[2 * CSV_ROW_MAX_LEN];
+
+    rand_state = CSV_SEED;
+    for (int i = 0; i < CSV_RANDOM_ROWS; i++) {
+        random_packet(&pkt);
+
+        int len = csv_format_row(row, &pkt);
+        int expected_len = reference_row(expected, sizeof(expected), &pkt);
+
+        zassert_true(len <= CSV_ROW_MAX_LEN, "row %d is %d bytes", i, len);
+        zassert_equal(len, expected_len, "row %d: %.*s vs %s", i, len, row, expected);
+        zassert_mem_equal(row, expected, len, "row %d: %.*s vs %s", i, len, row, expected);
+    }
+}
+
+ZTEST(csv_format, test_extremes)
+{
+    struct packet_data pkt;
+    char row[CSV_ROW_MAX_LEN];
+    char expected[2 * CSV_ROW_MAX_LEN];
+
+    memset(&pkt, 0, sizeof(pkt));
+    zassert_equal(csv_format_row(row, &pkt), reference_row(expected, sizeof(expected), &pkt));
+    zassert_mem_equal(row, expected, strlen(expected));
+
+    /* Every field at its widest, which is also the CSV_ROW_MAX_LEN case */
+    memset(&pkt, 0xFF, sizeof(pkt));
+    pkt.rssi = INT8_MIN;
+    pkt.tx_power = INT8_MIN;
+    zassert_equal(csv_format_row(row, &pkt), reference_row(expected, sizeof(expected), &pkt));
+    zassert_mem_equal(row, expected, strlen(expected));
+}
+
+ZTEST(csv_format, test_row_checksum)
+{
+    struct packet_data pkt;
+    char row[CSV_ROW_MAX_LEN];
+
+    rand_state = CSV_SEED;
+    random_packet(&pkt);
+
+    int len = csv_format_row(row, &pkt);
+
+    zassert_true(csv_row_valid(row, len - 1));
+    row[0] ^= 1;
+    zassert_equal(csv_row_valid(row, len - 1), !CSV_ROW_CHECKSUM);
+}
+
+/*
+ * Rows per second of both encoders on typical rows. native_sim does not
+ * advance its clock while code runs, so the numbers come from the boards.
+ */
+ZTEST(csv_format, test_bench)
+{
+    static struct packet_data pkts[64];
+    char row[2 * CSV_ROW_MAX_LEN];
+    volatile int sink = 0;
+    timing_t start, end;
+    uint64_t ns[2];
+
+    if (IS_ENABLED(CONFIG_BOARD_NATIVE_SIM)) {
+        ztest_test_skip();
+    }
+
+    rand_state = CSV_SEED;
+    for (int i = 0; i < ARRAY_SIZE(pkts); i++) {
+        random_packet(&pkts[i]);
+        pkts[i].tx_hour %= 24;
+        pkts[i].tx_minute %= 60;
+        pkts[i].tx_second %= 60;
+        pkts[i].tx_ms %= 1000;
+    }
+
+    timing_init();
+    timing_start();
+    for (int enc = 0; enc < 2; enc++) {
+        start = timing_counter_get();
+        for (int i = 0; i < CSV_BENCH_ROWS; i++) {
+            const struct packet_data *pkt = &pkts[i % ARRAY_SIZE(pkts)];
+
+            sink += enc ? reference_row(row, sizeof(row), pkt) : csv_format_row(row, pkt);
+        }
+        end = timing_counter_get();
+        ns[enc] = timing_cycles_to_ns(timing_cycles_get(&start, &end));
+    }
+    timing_stop();
+
+    TC_PRINT("csv_format_row: %llu rows/s, snprintf: %llu rows/s\n",
+             CSV_BENCH_ROWS * 1000000000ULL / MAX(ns[0], 1),
+             CSV_BENCH_ROWS * 1000000000ULL / MAX(ns[1], 1));
+    zassert_true(ns[0] < ns[1], "table encoder slower than snprintf");
+}
+
+ZTEST_SUITE(csv_format, NULL, NULL, NULL, NULL, NULL);
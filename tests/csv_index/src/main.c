@@ -0,0 +1,162 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdio.h>
+#include <zephyr/ztest.h>
+#include <zephyr/fs/fs.h>
+#include "sdcard_module.h"
+
+/*
+ * create_csv() on a test folder that already holds CSV_FILES files, once
+ * with a valid index file and once through the directory scan it falls
+ * back to. Both must pick the same next file. Every run remounts the disk
+ * so the index is found again instead of being taken from memory. As in
+ * sd_latency, native_sim does not advance its clock while code runs, the
+ * times logged there are 0 and only the indices are checked.
+ */
+#define CSV_FILES 1200
+#define CSV_FOLDER "/SD:/" CSV_TEST_NAME
+#define CSV_LAST (CSV_FILES - 1)
+
+static void csv_path(char *path, size_t size, int index)
+{
+    snprintf(path, size, "%s/%d.csv", CSV_FOLDER, index);
+}
+
+static bool csv_exists(int index)
+{
+    char path[64];
+    struct fs_dirent entry;
+
+    csv_path(path, sizeof(path), index);
+    return fs_stat(path, &entry) == 0;
+}
+
+static void csv_touch(int index)
+{
+    char path[64];
+    struct fs_file_t file;
+
+    csv_path(path, sizeof(path), index);
+    fs_file_t_init(&file);
+    zassert_ok(fs_open(&file, path, FS_O_WRITE | FS_O_CREATE), "%s", path);
+    fs_close(&file);
+}
+
+static void csv_remove(int index)
+{
+    char path[64];
+
+    csv_path(path, sizeof(path), index);
+    fs_unlink(path);
+}
+
+static void index_write(int index)
+{
+    char text[12];
+    struct fs_file_t file;
+    int len = snprintf(text, sizeof(text), "%d\n", index);
+
+    fs_file_t_init(&file);
+    zassert_ok(fs_open(&file, CSV_FOLDER "/index", FS_O_WRITE | FS_O_CREATE));
+    zassert_ok(fs_truncate(&file, 0));
+    zassert_equal(fs_write(&file, text, len), len);
+    fs_close(&file);
+}
+
+// Files 0..last and nothing above, the index holds stored or is missing if stored < 0
+static void folder_prepare(int last, int stored)
+{
+    static bool filled;
+
+    // A remounted card is read again, the last index is not kept from before
+    zassert_ok(disk_unmount());
+    zassert_ok(sdcard_init());
+
+    if (!filled) {
+        filled = true;
+        fs_mkdir(CSV_FOLDER);
+        for (int i = 0; i <= last; i++) {
+            csv_touch(i);
+        }
+    }
+    for (int i = last + 1; i <= last + 4; i++) {
+        csv_remove(i);
+    }
+    if (stored < 0) {
+        fs_unlink(CSV_FOLDER "/index");
+    } else {
+        index_write(stored);
+    }
+}
+
+// Create the next file, give its index and the time create_csv() took
+static void csv_create_timed(int *index, uint32_t *us)
+{
+    uint32_t start = k_cycle_get_32();
+
+    *index = -1;
+    zassert_ok(create_csv());
+    *us = k_cyc_to_us_floor32(k_cycle_get_32() - start);
+    zassert_ok(close_csv());
+
+    for (int i = CSV_LAST + 1; i <= CSV_LAST + 4; i++) {
+        if (csv_exists(i) && !csv_exists(i + 1)) {
+            *index = i;
+            return;
+        }
+    }
+}
+
+ZTEST(csv_index, test_index_matches_scan)
+{
+    uint32_t index_us, scan_us;
+    int from_index, from_scan;
+
+    folder_prepare(CSV_LAST, CSV_LAST);
+    csv_create_timed(&from_index, &index_us);
+
+    folder_prepare(CSV_LAST, -1);
+    csv_create_timed(&from_scan, &scan_us);
+
+    TC_PRINT("%d files: create_csv() %u us with the index, %u us with the scan\n", CSV_FILES,
+             index_us, scan_us);
+    zassert_equal(from_index, CSV_LAST + 1);
+    zassert_equal(from_scan, from_index, "scan picked %d, index %d", from_scan, from_index);
+}
+
+ZTEST(csv_index, test_stale_index)
+{
+    uint32_t us;
+    int index;
+
+    // A crash after creating N+1.csv, before the index was updated
+    folder_prepare(CSV_LAST, CSV_LAST);
+    csv_touch(CSV_LAST + 1);
+    csv_create_timed(&index, &us);
+    zassert_equal(index, CSV_LAST + 2);
+}
+
+ZTEST(csv_index, test_missing_index)
+{
+    uint32_t us;
+    int index;
+
+    folder_prepare(CSV_LAST, -1);
+    csv_create_timed(&index, &us);
+    zassert_equal(index, CSV_LAST + 1);
+}
+
+ZTEST(csv_index, test_index_ahead)
+{
+    uint32_t us;
+    int index;
+
+    // The index names a file that is not there, e.g. it was deleted by hand
+    folder_prepare(CSV_LAST, CSV_LAST + 2);
+    csv_create_timed(&index, &us);
+    zassert_equal(index, CSV_LAST + 1);
+}
+
+ZTEST_SUITE(csv_index, NULL, NULL, NULL, NULL, NULL);
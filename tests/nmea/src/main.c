@@ -0,0 +1,134 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdio.h>
+#include <zephyr/ztest.h>
+#include "nmea.h"
+
+/* The textbook RMC and GGA examples: 48 07.038' N, 11 31.000' E at 12:35:19 */
+#define RMC_EXAMPLE "$GPRMC,123519,A,4807.038,N,01131.000,E,022.4,084.4,230394,003.1,W*6A"
+#define GGA_EXAMPLE "$GPGGA,123519,4807.038,N,01131.000,E,1,08,0.9,545.4,M,46.9,M,,*47"
+#define EXAMPLE_LAT 48117300
+#define EXAMPLE_LON 11516666
+#define EXAMPLE_TIME_MS ((12 * 3600 + 35 * 60 + 19) * 1000)
+
+/* Wrap a sentence body as $body*hh with its checksum */
+static void nmea_sentence(char *buf, size_t size, const char *body)
+{
+    uint8_t sum = 0;
+
+    for (const char *c = body; *c; c++) {
+        sum ^= *c;
+    }
+    snprintf(buf, size, "$%s*%02X", body, sum);
+}
+
+static bool parse(const char *sentence, int32_t *time_ms, int32_t *lat, int32_t *lon)
+{
+    char line[96];
+
+    strncpy(line, sentence, sizeof(line) - 1);
+    line[sizeof(line) - 1] = '\0';
+    return nmea_parse(line, time_ms, lat, lon);
+}
+
+ZTEST(nmea, test_rmc)
+{
+    int32_t time_ms, lat, lon;
+
+    zassert_true(parse(RMC_EXAMPLE, &time_ms, &lat, &lon));
+    zassert_equal(time_ms, EXAMPLE_TIME_MS);
+    zassert_equal(lat, EXAMPLE_LAT, "lat %d", lat);
+    zassert_equal(lon, EXAMPLE_LON, "lon %d", lon);
+}
+
+ZTEST(nmea, test_gga)
+{
+    int32_t time_ms, lat, lon;
+
+    zassert_true(parse(GGA_EXAMPLE, &time_ms, &lat, &lon));
+    zassert_equal(time_ms, EXAMPLE_TIME_MS);
+    zassert_equal(lat, EXAMPLE_LAT, "lat %d", lat);
+    zassert_equal(lon, EXAMPLE_LON, "lon %d", lon);
+}
+
+ZTEST(nmea, test_south_west)
+{
+    char line[96];
+    int32_t time_ms, lat, lon;
+
+    nmea_sentence(line, sizeof(line), "GNRMC,000001.50,A,3351.000,S,15112.500,W,0.0,0.0,010125,,");
+    zassert_true(parse(line, &time_ms, &lat, &lon));
+    zassert_equal(time_ms, 1500);
+    zassert_equal(lat, -33850000, "lat %d", lat);
+    zassert_equal(lon, -151208333, "lon %d", lon);
+
+    nmea_sentence(line, sizeof(line), "GPGGA,235959,0030.000,S,00000.600,W,2,05,1.2,10.0,M,0.0,M,,");
+    zassert_true(parse(line, &time_ms, &lat, &lon));
+    zassert_equal(time_ms, (23 * 3600 + 59 * 60 + 59) * 1000);
+    zassert_equal(lat, -500000, "lat %d", lat);
+    zassert_equal(lon, -10000, "lon %d", lon);
+}
+
+ZTEST(nmea, test_coord)
+{
+    zassert_equal(nmea_coord("4807.038", "N"), EXAMPLE_LAT);
+    zassert_equal(nmea_coord("4807.038", "S"), -EXAMPLE_LAT);
+    zassert_equal(nmea_coord("00000.0001", "E"), 1);
+    zassert_equal(nmea_coord("18000.000", "W"), -180000000);
+    zassert_equal(nmea_coord("0000", "N"), 0);
+}
+
+ZTEST(nmea, test_checksum)
+{
+    char line[96];
+
+    strcpy(line, RMC_EXAMPLE);
+    zassert_true(nmea_checksum_ok(line));
+    zassert_equal(strchr(line, '*'), NULL, "checksum not cut off");
+
+    strcpy(line, "$GPRMC,123519,A,4807.038,N,01131.000,E,022.4,084.4,230394,003.1,W*6a");
+    zassert_true(nmea_checksum_ok(line), "lower case hex");
+
+    strcpy(line, "$GPRMC,123519,A,4807.038,N,01131.000,E,022.4,084.4,230394,003.1,W*6B");
+    zassert_false(nmea_checksum_ok(line));
+
+    strcpy(line, "$GPRMC,123519,A,4807.038,N,01131.000,E,022.4,084.4,230394,003.1,W");
+    zassert_false(nmea_checksum_ok(line), "no checksum");
+
+    strcpy(line, "GPRMC,123519,A,4807.038,N,01131.000,E,022.4,084.4,230394,003.1,W*6A");
+    zassert_false(nmea_checksum_ok(line), "no $");
+}
+
+ZTEST(nmea, test_rejected)
+{
+    char line[96];
+    int32_t time_ms, lat, lon;
+
+    /* One flipped digit, the checksum no longer matches */
+    zassert_false(parse("$GPRMC,123519,A,4807.039,N,01131.000,E,022.4,084.4,230394,003.1,W*6A",
+                        &time_ms, &lat, &lon));
+
+    /* RMC status V: receiver warning, no fix */
+    nmea_sentence(line, sizeof(line), "GPRMC,123519,V,4807.038,N,01131.000,E,,,230394,,");
+    zassert_false(parse(line, &time_ms, &lat, &lon));
+
+    /* GGA fix quality 0 */
+    nmea_sentence(line, sizeof(line), "GPGGA,123519,4807.038,N,01131.000,E,0,00,,,M,,M,,");
+    zassert_false(parse(line, &time_ms, &lat, &lon));
+
+    /* Status A but the position fields are empty */
+    nmea_sentence(line, sizeof(line), "GPRMC,123519,A,,,,,,,230394,,");
+    zassert_false(parse(line, &time_ms, &lat, &lon));
+
+    /* Other sentence types carry no fix for the replay */
+    nmea_sentence(line, sizeof(line), "GPGSV,3,1,11,03,03,111,00,04,15,270,00,06,01,010,00,13,06,292,00");
+    zassert_false(parse(line, &time_ms, &lat, &lon));
+
+    /* Too few fields */
+    nmea_sentence(line, sizeof(line), "GPRMC,123519,A");
+    zassert_false(parse(line, &time_ms, &lat, &lon));
+}
+
+ZTEST_SUITE(nmea, NULL, NULL, NULL, NULL, NULL);
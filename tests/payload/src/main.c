@@ -0,0 +1,177 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <zephyr/ztest.h>
+#include "ble_settings.h"
+#include "payload_module.h"
+#include "test_rand.h"
+
+#define FUZZ_RUNS 200000
+#define FUZZ_SEED 0x9E3779B9
+
+#define FIELD_DIFFERS(name, type, bytes) || a->name != b->name
+
+static bool payload_differs(const struct adv_payload *a, const struct adv_payload *b)
+{
+    if (false ADV_PAYLOAD_FIXED(FIELD_DIFFERS)) {
+        return true;
+    }
+    if ((a->header & ADV_HDR_ANCHOR) ? (false ADV_PAYLOAD_ANCHOR(FIELD_DIFFERS))
+                                     : (false ADV_PAYLOAD_DELTA(FIELD_DIFFERS))) {
+        return true;
+    }
+    return (a->msg_type & ADV_MSG_SYNC) && (false ADV_PAYLOAD_SYNC(FIELD_DIFFERS));
+}
+
+static bool history_differs(const struct adv_history *a, const struct adv_history *b)
+{
+    return false ADV_PAYLOAD_HISTORY(FIELD_DIFFERS);
+}
+
+/* Random message of one variant, delta positions only hold what 16 bits carry */
+static void random_payload(struct adv_payload *p, bool anchor, bool sync)
+{
+    *p = (struct adv_payload){
+        .header = (rand_next() & ~ADV_HDR_ANCHOR) | (anchor ? ADV_HDR_ANCHOR : 0),
+        .number_press = rand_next(),
+        .timestamp = rand_next(),
+        .tx_delay = rand_next(),
+        .latitude = anchor ? rand_next() : (uint32_t)(int16_t)rand_next(),
+        .longitude = anchor ? rand_next() : (uint32_t)(int16_t)rand_next(),
+        .gap_report = rand_next(),
+        .hops = rand_next(),
+        .msg_type = (rand_next() & ~ADV_MSG_SYNC) | (sync ? ADV_MSG_SYNC : 0),
+        .sync_us = sync ? rand_next() : 0,
+    };
+}
+
+ZTEST(payload, test_round_trip_variants)
+{
+    static const uint8_t expected_len[2][2] = {
+        {ADV_PAYLOAD_DELTA_LEN, ADV_PAYLOAD_DELTA_LEN + ADV_PAYLOAD_SYNC_LEN},
+        {ADV_PAYLOAD_ANCHOR_LEN, ADV_PAYLOAD_ANCHOR_LEN + ADV_PAYLOAD_SYNC_LEN},
+    };
+    uint8_t buf[ADV_PAYLOAD_MAX_LEN];
+    struct adv_payload in, out;
+
+    rand_state = FUZZ_SEED;
+    for (int i = 0; i < 1000; i++) {
+        for (int anchor = 0; anchor < 2; anchor++) {
+            for (int sync = 0; sync < 2; sync++) {
+                random_payload(&in, anchor, sync);
+
+                uint8_t len = adv_payload_pack(&in, buf);
+
+                zassert_equal(len, expected_len[anchor][sync]);
+                zassert_equal(len, adv_payload_len(&in));
+                zassert_true(adv_payload_is_ours(buf, len));
+                zassert_equal(adv_payload_origin(buf), in.header & ADV_HDR_NODE_MASK);
+                zassert_ok(adv_payload_unpack(&out, buf, len));
+                zassert_false(payload_differs(&in, &out), "anchor %d sync %d", anchor, sync);
+
+                /* Every shorter prefix is refused */
+                for (uint8_t cut = 0; cut < len; cut++) {
+                    zassert_equal(adv_payload_unpack(&out, buf, cut), -EMSGSIZE, "cut %u", cut);
+                }
+            }
+        }
+    }
+}
+
+ZTEST(payload, test_round_trip_history)
+{
+    struct adv_history in[4], out[5];
+    uint8_t buf[ARRAY_SIZE(in) * ADV_HISTORY_ENTRY_LEN];
+
+    rand_state = FUZZ_SEED;
+    for (int i = 0; i < 1000; i++) {
+        for (int n = 0; n < ARRAY_SIZE(in); n++) {
+            in[n] = (struct adv_history){rand_next(), rand_next(), rand_next(), rand_next()};
+        }
+
+        uint8_t len = adv_history_pack(in, ARRAY_SIZE(in), buf);
+
+        zassert_equal(len, sizeof(buf));
+        zassert_equal(adv_history_unpack(out, ARRAY_SIZE(out), buf, len), ARRAY_SIZE(in));
+        for (int n = 0; n < ARRAY_SIZE(in); n++) {
+            zassert_false(history_differs(&in[n], &out[n]), "entry %d", n);
+        }
+
+        /* Incomplete entries are dropped and max is respected */
+        zassert_equal(adv_history_unpack(out, ARRAY_SIZE(out), buf, len - 1), ARRAY_SIZE(in) - 1);
+        zassert_equal(adv_history_unpack(out, 2, buf, len), 2);
+        zassert_equal(adv_history_unpack(out, ARRAY_SIZE(out), buf, 0), 0);
+    }
+}
+
+ZTEST(payload, test_foreign_company)
+{
+    uint8_t buf[ADV_PAYLOAD_MAX_LEN];
+    struct adv_payload in, out;
+
+    rand_state = FUZZ_SEED;
+    random_payload(&in, true, false);
+
+    uint8_t len = adv_payload_pack(&in, buf);
+
+    buf[0] ^= 0x01;
+    zassert_false(adv_payload_is_ours(buf, len));
+    zassert_equal(adv_payload_unpack(&out, buf, len), -EBADMSG);
+}
+
+/*
+ * Random buffers of random length, with our company id half of the time so
+ * the decoder gets past the first check. Decoding must leave its input
+ * alone, never accept a message longer than len and only fail with the
+ * documented errors.
+ */
+ZTEST(payload, test_fuzz_unpack)
+{
+    uint8_t buf[ADV_PAYLOAD_MAX_LEN + 8];
+    struct adv_payload out;
+    uint32_t decoded = 0;
+
+    rand_state = FUZZ_SEED;
+    for (int i = 0; i < FUZZ_RUNS; i++) {
+        size_t len = rand_next() % (ADV_PAYLOAD_MAX_LEN + 1);
+
+        for (size_t n = 0; n < sizeof(buf); n++) {
+            buf[n] = rand_next();
+        }
+        if (rand_next() & 1) {
+            buf[0] = COMPANY_ID_CODE & 0xFF;
+            buf[1] = COMPANY_ID_CODE >> 8;
+        }
+
+        uint8_t guard[sizeof(buf)];
+
+        memcpy(guard, buf, sizeof(buf));
+
+        int err = adv_payload_unpack(&out, buf, len);
+
+        zassert_mem_equal(buf, guard, sizeof(buf), "unpack wrote to its input");
+        if (err == 0) {
+            decoded++;
+            zassert_true(adv_payload_is_ours(buf, len));
+            zassert_true(adv_payload_len(&out) <= len, "read past len %u", len);
+
+            /* What was accepted packs back to the same bytes */
+            uint8_t repacked[ADV_PAYLOAD_MAX_LEN];
+            uint8_t repacked_len = adv_payload_pack(&out, repacked);
+
+            zassert_equal(repacked_len, adv_payload_len(&out));
+            zassert_mem_equal(repacked, buf, repacked_len);
+        } else {
+            zassert_true(err == -EMSGSIZE || err == -EBADMSG, "err %d", err);
+            if (len >= ADV_PAYLOAD_FIXED_LEN && err == -EMSGSIZE) {
+                zassert_true(adv_payload_is_ours(buf, len));
+            }
+        }
+    }
+    zassert_true(decoded > 0, "the fuzzer never produced a valid message");
+}
+
+ZTEST_SUITE(payload, NULL, NULL, NULL, NULL, NULL);
@@ -0,0 +1,117 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdio.h>
+#include <zephyr/ztest.h>
+#include <zephyr/fs/fs.h>
+#include "csv_format.h"
+#include "ble_settings.h"
+
+/*
+ * One test worth of rows through the SD writer, run once with CSV_PREALLOC
+ * and once without (see testcase.yaml). close_csv() logs the p50, p99 and
+ * max write latency of each run. native_sim does not advance its clock
+ * while code runs, there the runs only check that both paths write the
+ * same file; the latencies come from the board:
+ *
+ *   west twister -T tests/sd_latency -p nrf5340dk_nrf5340_cpuapp_ns --device-testing
+ */
+#define SD_ROWS (TEST_PERIOD * 1000 / INTERVAL)
+
+static void *sd_latency_setup(void)
+{
+    zassert_ok(sdcard_init());
+    return NULL;
+}
+
+/* Bytes of the SD_ROWS rows the tests write */
+static off_t rows_size(void)
+{
+    struct packet_data pkt = {0};
+    char row[CSV_ROW_MAX_LEN];
+    off_t size = 0;
+
+    for (int i = 0; i < SD_ROWS; i++) {
+        pkt.number_press = i;
+        pkt.tx_ms = i % 1000;
+        pkt.rssi = -40 - i % 60;
+        size += csv_format_row(row, &pkt);
+    }
+    return size;
+}
+
+/* One test file worth of rows, then only the rows must be left in it */
+static void write_rows_and_check(void)
+{
+    struct packet_data pkt = {0};
+    off_t expected = rows_size();
+
+    zassert_ok(create_csv());
+    for (int i = 0; i < SD_ROWS; i++) {
+        pkt.number_press = i;
+        pkt.tx_ms = i % 1000;
+        pkt.rssi = -40 - i % 60;
+        zassert_ok(append_csv(&pkt), "row %d", i);
+    }
+    zassert_ok(close_csv());
+
+    /* Only the rows are left, the preallocated tail is trimmed */
+    struct fs_dirent entry;
+    char path[64];
+    int index = -1;
+    struct fs_dir_t dir;
+
+    fs_dir_t_init(&dir);
+    zassert_ok(fs_opendir(&dir, "/SD:/" CSV_TEST_NAME));
+    while (fs_readdir(&dir, &entry) == 0 && entry.name[0] != '\0') {
+        int n;
+
+        if (sscanf(entry.name, "%d.csv", &n) == 1 && n > index) {
+            index = n;
+        }
+    }
+    fs_closedir(&dir);
+
+    snprintf(path, sizeof(path), "/SD:/%s/%d.csv", CSV_TEST_NAME, index);
+    zassert_ok(fs_stat(path, &entry));
+    zassert_equal(entry.size, expected, "%s is %u bytes, %u written", path,
+                  (uint32_t)entry.size, (uint32_t)expected);
+}
+
+ZTEST(sd_latency, test_test_period)
+{
+    write_rows_and_check();
+}
+
+/*
+ * Room for the rows but not for the preallocation: FatFs extends the file
+ * as far as it can and reports success, the writer must notice and append.
+ */
+ZTEST(sd_latency, test_volume_almost_full)
+{
+    struct fs_statvfs stat;
+    struct fs_file_t filler;
+
+    /* Filling a real card would take ages, the RAM disk is small */
+    if (!IS_ENABLED(CONFIG_BOARD_NATIVE_SIM)) {
+        ztest_test_skip();
+    }
+
+    zassert_ok(fs_statvfs("/SD:", &stat));
+
+    off_t free_bytes = (off_t)stat.f_bfree * stat.f_frsize;
+    off_t leave = rows_size() + 8 * stat.f_frsize;
+
+    zassert_true(free_bytes > leave, "RAM disk too small");
+
+    fs_file_t_init(&filler);
+    zassert_ok(fs_open(&filler, "/SD:/filler", FS_O_WRITE | FS_O_CREATE));
+    zassert_ok(fs_truncate(&filler, free_bytes - leave));
+    fs_close(&filler);
+
+    write_rows_and_check();
+    zassert_ok(fs_unlink("/SD:/filler"));
+}
+
+ZTEST_SUITE(sd_latency, NULL, sd_latency_setup, NULL, NULL, NULL);